@@ -0,0 +1,92 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: batch-renderer.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "batch-renderer.h"
+#include "thread-pool.h"
+
+BatchRenderer::BatchRenderer(int framesInFlight)
+    : framesInFlight(framesInFlight > 0 ? framesInFlight : threadPool().size())
+{
+    for (int i = 0; i < this->framesInFlight; i++)
+    {
+        workers.push_back(std::make_unique<FrameWorker>());
+        workers.back()->index = i;
+    }
+}
+
+/************************************************************************
+* Workers pull frame numbers off a shared counter until the range runs
+* out. When there are enough frames in flight to fill the thread pool,
+* each frame's own ops run serially on its worker; with fewer, the ops
+* still split across the pool to use the spare cores.
+************************************************************************/
+void BatchRenderer::render(int first, int last, const FrameFunction& renderFrame)
+{
+    using clock = std::chrono::steady_clock;
+    timings.assign(std::max(0, last - first + 1), { 0, 0, 0.0 });
+    std::atomic<int> next(first);
+    std::mutex printMutex;
+    bool serialFrames = framesInFlight >= threadPool().size();
+
+    auto work = [&](FrameWorker& worker)
+    {
+        std::unique_ptr<SerialScope> serial;
+        if (serialFrames)
+        {
+            serial = std::make_unique<SerialScope>();
+        }
+        for (int frame = next++; frame <= last; frame = next++)
+        {
+            auto start = clock::now();
+            renderFrame(frame, worker);
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            timings[frame - first] = { frame, worker.index, ms };
+            if (verbose)
+            {
+                std::lock_guard<std::mutex> lock(printMutex);
+                std::cout << "Frame " << frame << " completed in " << ms << "ms on worker " << worker.index << std::endl;
+            }
+        }
+    };
+
+    auto totalStart = clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 1; i < framesInFlight; i++)
+    {
+        threads.emplace_back(work, std::ref(*workers[i]));
+    }
+    work(*workers[0]);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    totalMs = std::chrono::duration<double, std::milli>(clock::now() - totalStart).count();
+
+    if (verbose)
+    {
+        double frameMs = 0.0;
+        for (const FrameTiming& timing : timings)
+        {
+            frameMs += timing.ms;
+        }
+        int frames = int(timings.size());
+        std::cout << std::endl << "Sequence Complete!" << std::endl;
+        std::cout << "Frames: " << frames << " on " << framesInFlight << " workers" << std::endl;
+        std::cout << "Total Wall Time: " << totalMs << "ms" << std::endl;
+        std::cout << "Sum of Frame Times: " << frameMs << "ms" << std::endl;
+        if (frames > 0)
+        {
+            std::cout << "Average Frame Time: " << frameMs / frames << "ms" << std::endl;
+            std::cout << "Throughput: " << 1000.0 * frames / totalMs << " frames/s" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: batch-renderer.h
+ *
+ * Renders the frames of a sequence concurrently. Frames are independent,
+ * so each worker thread takes the next unrendered frame, renders it with
+ * its own ImagePipeline and output image, and moves on. The number of
+ * workers caps how many frames, and so how many sets of buffers, are
+ * alive at once.
+************************************************************************/
+
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "image.h"
+
+// Everything one worker owns, reused from frame to frame
+struct FrameWorker
+{
+    int index;
+    ImagePipeline pipeline;
+    Image output;
+};
+
+// Render and write one frame with the worker's buffers
+using FrameFunction = std::function<void(int frame, FrameWorker& worker)>;
+
+struct FrameTiming
+{
+    int frame;
+    int worker;
+    double ms;
+};
+
+class BatchRenderer
+{
+public:
+    int framesInFlight;
+    bool verbose = true; // Print a line per frame and a summary
+
+    // Results of the last render(), timings in frame order
+    std::vector<FrameTiming> timings;
+    double totalMs = 0.0;
+
+    // 0 frames in flight picks the thread pool's size
+    explicit BatchRenderer(int framesInFlight = 0);
+
+    int workerCount() const { return framesInFlight; }
+    // Renders frames first through last inclusive
+    void render(int first, int last, const FrameFunction& renderFrame);
+
+private:
+    std::vector<std::unique_ptr<FrameWorker>> workers;
+};
+
+#endif
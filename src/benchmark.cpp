@@ -0,0 +1,966 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: benchmark.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "byte-kernels.h"
+#include "frame-file.h"
+#include "image.h"
+#include "math.h"
+#include "mip-pyramid.h"
+#include "node-graph.h"
+#include "pixel-kernels.h"
+#include "temporal-sampler.h"
+#include "thread-pool.h"
+#include "viewport.h"
+
+/************************************************************************
+* Deterministic test plate with detail at every scale, so that blurs
+* don't get to skip work on flat regions.
+************************************************************************/
+static void fillTestImage(Image& image, int width, int height)
+{
+    image.resize(width, height);
+    unsigned int seed = 12345;
+    for (int i = 0; i < image.pixelCount; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        float noise = float(seed >> 8) / float(1 << 24);
+        int x = i % width;
+        int y = i / width;
+        image[i] = col4f(
+            0.5f + 0.5f * sin(0.01f * x),
+            0.5f + 0.5f * cos(0.013f * y),
+            noise,
+            1.0f
+        );
+    }
+}
+
+// Smooth waves in red and green and 64 pixel checks in blue. A blur
+// attenuates all of it without wiping it out, unlike the per-pixel noise
+// in fillTestImage, so there is something left to deconvolve.
+static void fillStructuredImage(Image& image, int width, int height)
+{
+    image.resize(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            image(x, y) = col4f(
+                0.5f + 0.25f * sin(0.11f * x) * cos(0.07f * y) + 0.2f * sin(0.031f * (x + y)),
+                0.5f + 0.3f * sin(0.23f * x + 0.05f * y),
+                ((x / 64 + y / 64) % 2) ? 0.8f : 0.2f,
+                1.0f
+            );
+        }
+    }
+}
+
+static float maxDifference(const Image& a, const Image& b)
+{
+    float diff = 0.0f;
+    for (int i = 0; i < a.pixelCount; i++)
+    {
+        diff = std::max(diff, std::abs(a[i].r - b[i].r));
+        diff = std::max(diff, std::abs(a[i].g - b[i].g));
+        diff = std::max(diff, std::abs(a[i].b - b[i].b));
+        diff = std::max(diff, std::abs(a[i].a - b[i].a));
+    }
+    return diff;
+}
+
+static float rmsDifference(const Image& a, const Image& b)
+{
+    double sum = 0.0;
+    for (int i = 0; i < a.pixelCount; i++)
+    {
+        col4f d = a[i] - b[i];
+        sum += d.r * d.r + d.g * d.g + d.b * d.b;
+    }
+    return float(sqrt(sum / (3.0 * a.pixelCount)));
+}
+
+template <typename F>
+static double timeMs(F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Fastest of several runs, so first-touch page faults on outputs don't count
+template <typename F>
+static double bestMs(F&& f, int runs = 3)
+{
+    double best = timeMs(f);
+    for (int i = 1; i < runs; i++)
+    {
+        best = std::min(best, timeMs(f));
+    }
+    return best;
+}
+
+/************************************************************************
+* TemporalSampler::processFrame as it started, kept as a baseline.
+* Mask copied in by value, column-major, a lerp, clamp and frame lookup
+* per pixel.
+************************************************************************/
+static void referenceTemporalSample(std::vector<Image>& inputFrames, std::vector<Image>& outputFrames,
+                                    int frameNo, int minFrameOffset, int maxFrameOffset, Image mask)
+{
+    minFrameOffset = std::max(0, minFrameOffset);
+    maxFrameOffset = std::min(int(inputFrames.size() - 1), maxFrameOffset);
+    for (int x = 0; x < inputFrames[frameNo].width; x++)
+    {
+        for (int y = 0; y < inputFrames[frameNo].height; y++)
+        {
+            int frameOffset = int(linear_interpolation(mask(x, y).a, minFrameOffset, maxFrameOffset));
+            int index = clamp(frameNo + frameOffset, 0, inputFrames.size() - 1);
+            outputFrames[frameNo](x, y) = inputFrames[index](x, y);
+        }
+    }
+}
+
+/************************************************************************
+* The gaussianBlur this repo started with, kept as a baseline.
+* Column-major traversal of a row-major buffer, clamped reads on every tap.
+************************************************************************/
+static void referenceGaussianBlur(const Image& input, Image& output, Image& temp, int kernel)
+{
+    temp.resize(input.width, input.height);
+    output.resize(input.width, input.height);
+    if (kernel % 2 == 0)
+    {
+        kernel++;
+    }
+    int offset = int(kernel / 2);
+    std::vector<float> convolution(offset + 1, 0);
+    float stdev = float(kernel - 1) / 6.0f;
+    float one_over_sqrt_2_pi_stdevsqrd = 1.0f/sqrt(2.0f * std::numbers::pi * stdev * stdev);
+    for (int x = 0; x <= +offset; x++)
+    {
+        convolution[x] = one_over_sqrt_2_pi_stdevsqrd * exp(- (x * x) / (2.0f * stdev * stdev));
+    }
+    for (int x = 0; x < input.width; x++)
+    {
+        for (int y = 0; y < input.height; y++)
+        {
+            temp(x, y) = { 0.0f, 0.0f, 0.0f, input(x, y).a };
+            for (int i = -offset; i <= +offset; i++)
+            {
+                temp(x, y).r += convolution[std::abs(i)] * input.clamped(x + i, y).r;
+                temp(x, y).g += convolution[std::abs(i)] * input.clamped(x + i, y).g;
+                temp(x, y).b += convolution[std::abs(i)] * input.clamped(x + i, y).b;
+            }
+        }
+    }
+    for (int x = 0; x < input.width; x++)
+    {
+        for (int y = 0; y < input.height; y++)
+        {
+            output(x, y) = { 0.0f, 0.0f, 0.0f, input(x, y).a };
+            for (int j = -offset; j <= +offset; j++)
+            {
+                output(x, y).r += convolution[std::abs(j)] * temp.clamped(x, y + j).r;
+                output(x, y).g += convolution[std::abs(j)] * temp.clamped(x, y + j).g;
+                output(x, y).b += convolution[std::abs(j)] * temp.clamped(x, y + j).b;
+            }
+        }
+    }
+}
+
+void blurBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image reference;
+    Image output;
+    Image temp;
+    int sizes[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    int kernels[3] = { 9, 51, 101 };
+
+    std::cout << "gaussianBlur: reference vs row-major engine" << std::endl;
+    for (auto& size : sizes)
+    {
+        fillTestImage(input, size[0], size[1]);
+        for (int kernel : kernels)
+        {
+            double referenceMs = timeMs([&] { referenceGaussianBlur(input, reference, temp, kernel); });
+            double engineMs = timeMs([&] { imgPipeline.gaussianBlur(input, output, kernel); });
+            std::cout << std::fixed << std::setprecision(1)
+                      << size[0] << "x" << size[1] << " kernel " << kernel
+                      << ": reference " << referenceMs << "ms"
+                      << ", engine " << engineMs << "ms"
+                      << ", speedup " << referenceMs / engineMs << "x"
+                      << std::scientific << std::setprecision(2)
+                      << ", max diff " << maxDifference(reference, output)
+                      << std::endl;
+        }
+    }
+}
+
+void blurModeBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image exact;
+    Image box;
+    int kernels[5] = { 9, 25, 51, 101, 201 };
+    fillTestImage(input, 1920, 1080);
+
+    std::cout << "gaussianBlur 1920x1080: BlurMode::Exact vs BlurMode::Box" << std::endl;
+    for (int kernel : kernels)
+    {
+        double exactMs = timeMs([&] { imgPipeline.gaussianBlur(input, exact, kernel, BlurMode::Exact); });
+        double boxMs = timeMs([&] { imgPipeline.gaussianBlur(input, box, kernel, BlurMode::Box); });
+        std::cout << std::fixed << std::setprecision(1)
+                  << "kernel " << kernel
+                  << ": exact " << exactMs << "ms"
+                  << ", box " << boxMs << "ms"
+                  << ", speedup " << exactMs / boxMs << "x"
+                  << std::scientific << std::setprecision(2)
+                  << ", max diff " << maxDifference(exact, box)
+                  << ", rms diff " << rmsDifference(exact, box)
+                  << std::endl;
+    }
+}
+
+void deblurBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image blurred;
+    Image deblurred;
+    int kernels[3] = { 9, 25, 51 };
+    float regularizations[4] = { 1e-2f, 1e-3f, 1e-4f, 1e-5f };
+    fillStructuredImage(input, 1920, 1080);
+
+    std::cout << "gaussianDeBlur 1920x1080, rms error against the unblurred plate for each lambda" << std::endl;
+    for (int kernel : kernels)
+    {
+        imgPipeline.gaussianBlur(input, blurred, kernel);
+        double deblurMs = timeMs([&] { imgPipeline.gaussianDeBlur(blurred, deblurred, kernel); });
+        std::cout << std::fixed << std::setprecision(1)
+                  << "kernel " << kernel
+                  << ": " << deblurMs << "ms"
+                  << std::scientific << std::setprecision(2)
+                  << ", blurred " << rmsDifference(input, blurred);
+        float bestError = 0.0f;
+        float bestRegularization = 0.0f;
+        for (float regularization : regularizations)
+        {
+            imgPipeline.gaussianDeBlur(blurred, deblurred, kernel, regularization);
+            float error = rmsDifference(input, deblurred);
+            std::cout << ", " << std::setprecision(0) << regularization << " " << std::setprecision(2) << error;
+            if (bestRegularization == 0.0f || error < bestError)
+            {
+                bestError = error;
+                bestRegularization = regularization;
+            }
+        }
+        std::cout << std::setprecision(0) << ", best lambda " << bestRegularization
+                  << std::setprecision(2) << " recovers " << std::fixed
+                  << rmsDifference(input, blurred) / bestError << "x" << std::endl;
+    }
+}
+
+void planarBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image output;
+    Image converted;
+    PlanarImage planarInput;
+    PlanarImage planarOutput;
+    fillTestImage(input, 1920, 1080);
+    planarInput.read(input);
+    col4f weights = col4f(0.3f, 0.59f, 0.11f, 1.0f);
+
+    auto report = [&](const char* name, double interleavedMs, double planarMs)
+    {
+        planarOutput.write(converted);
+        std::cout << std::fixed << std::setprecision(2)
+                  << name << ": interleaved " << interleavedMs << "ms"
+                  << ", planar " << planarMs << "ms"
+                  << ", speedup " << interleavedMs / planarMs << "x"
+                  << std::scientific << std::setprecision(2)
+                  << ", max diff " << maxDifference(output, converted)
+                  << std::endl;
+    };
+
+    std::cout << "Image vs PlanarImage, 1920x1080" << std::endl;
+    double readMs = bestMs([&] { planarInput.read(input); });
+    double writeMs = bestMs([&] { planarInput.write(converted); });
+    std::cout << std::fixed << std::setprecision(2)
+              << "conversion: read " << readMs << "ms, write " << writeMs << "ms" << std::endl;
+    report("toNegative",
+           bestMs([&] { imgPipeline.toNegative(input, output); }),
+           bestMs([&] { imgPipeline.toNegative(planarInput, planarOutput); }));
+    report("scaleBrightness",
+           bestMs([&] { imgPipeline.scaleBrightness(input, output, 1.5f); }),
+           bestMs([&] { imgPipeline.scaleBrightness(planarInput, planarOutput, 1.5f); }));
+    report("scaleContrast",
+           bestMs([&] { imgPipeline.scaleContrast(input, output, 1.5f); }),
+           bestMs([&] { imgPipeline.scaleContrast(planarInput, planarOutput, 1.5f); }));
+    report("toGreyscale",
+           bestMs([&] { imgPipeline.toGreyscale(input, output, weights); }),
+           bestMs([&] { imgPipeline.toGreyscale(planarInput, planarOutput, weights); }));
+    report("threshold",
+           bestMs([&] { imgPipeline.threshold(input, output, 0.5f); }),
+           bestMs([&] { imgPipeline.threshold(planarInput, planarOutput, 0.5f); }));
+    report("thresholdColor",
+           bestMs([&] { imgPipeline.thresholdColor(input, output, 0.5f); }),
+           bestMs([&] { imgPipeline.thresholdColor(planarInput, planarOutput, 0.5f); }));
+    report("composite",
+           bestMs([&] { imgPipeline.composite(input, input, output, input); }),
+           bestMs([&] { imgPipeline.composite(planarInput, planarInput, planarOutput, planarInput); }));
+    report("gaussianBlur 51",
+           bestMs([&] { imgPipeline.gaussianBlur(input, output, 51); }),
+           bestMs([&] { imgPipeline.gaussianBlur(planarInput, planarOutput, 51); }));
+}
+
+void pixelKernelBenchmark()
+{
+    Image input;
+    Image mask;
+    Image scalarOut;
+    Image simdOut;
+    fillTestImage(input, 1920, 1080);
+    fillTestImage(mask, 1920, 1080);
+    for (int i = 0; i < mask.pixelCount; i++)
+    {
+        mask[i].a = mask[i].b;
+    }
+    scalarOut.resize(1920, 1080);
+    simdOut.resize(1920, 1080);
+    const PixelKernels& scalar = scalarPixelKernels();
+    const PixelKernels& simd = cpuHasAVX2() ? avx2PixelKernels() : scalarPixelKernels();
+    const col4f* in = input.buffer.data();
+    const col4f* m = mask.buffer.data();
+    int count = input.pixelCount;
+    col4f tint = col4f(1.0f, 0.5f, 0.0f, 0.3f);
+    col4f weights = col4f(0.3f, 0.59f, 0.11f, 1.0f);
+    col4f_hsv_t hsv = { 200.0f, 0.8f, 1.2f, 1.0f };
+
+    std::cout << "Pixel kernels 1920x1080, " << scalar.name << " vs " << simd.name << ", Mpixels/s" << std::endl;
+    auto run = [&](const char* name, auto&& op)
+    {
+        double scalarMs = bestMs([&] { op(scalar, scalarOut.buffer.data()); }, 5);
+        double simdMs = bestMs([&] { op(simd, simdOut.buffer.data()); }, 5);
+        std::cout << std::fixed << std::setprecision(0)
+                  << name << ": " << scalar.name << " " << count / (1000.0 * scalarMs)
+                  << ", " << simd.name << " " << count / (1000.0 * simdMs)
+                  << std::setprecision(2) << ", speedup " << scalarMs / simdMs << "x"
+                  << std::scientific << ", max diff " << maxDifference(scalarOut, simdOut)
+                  << std::endl;
+    };
+    run("negative", [&](const PixelKernels& k, col4f* out) { k.negative(in, out, count); });
+    run("scaleBrightness", [&](const PixelKernels& k, col4f* out) { k.scaleBrightness(in, out, count, 1.5f); });
+    run("colorTint", [&](const PixelKernels& k, col4f* out) { k.colorTint(in, out, count, tint); });
+    run("toGreyscale", [&](const PixelKernels& k, col4f* out) { k.toGreyscale(in, out, count, weights); });
+    run("threshold", [&](const PixelKernels& k, col4f* out) { k.threshold(in, out, count, 0.5f); });
+    run("thresholdColor", [&](const PixelKernels& k, col4f* out) { k.thresholdColor(in, out, count, 0.5f); });
+    run("maskify", [&](const PixelKernels& k, col4f* out) { k.maskify(in, out, count); });
+    run("composite", [&](const PixelKernels& k, col4f* out) { k.composite(in, m, m, out, count); });
+    run("adjustHSV", [&](const PixelKernels& k, col4f* out) { k.adjustHSV(in, out, count, hsv); });
+}
+
+void pointChainBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image background;
+    Image mask;
+    Image separate;
+    Image fused;
+    fillTestImage(input, 1920, 1080);
+    fillTestImage(background, 1920, 1080);
+    imgPipeline.toNegative(background, background);
+    imgPipeline.maskify(input, mask);
+    col4f tint = col4f(1.0f, 0.5f, 0.0f, 0.3f);
+
+    PointChain chain;
+    chain.negative()
+         .scaleBrightness(1.2f)
+         .colorTint(tint)
+         .thresholdColor(0.3f)
+         .composite(background, mask);
+
+    double separateMs = bestMs([&]
+    {
+        imgPipeline.toNegative(input, separate);
+        imgPipeline.scaleBrightness(separate, separate, 1.2f);
+        imgPipeline.colorTint(separate, separate, tint);
+        imgPipeline.thresholdColor(separate, separate, 0.3f);
+        imgPipeline.composite(separate, background, separate, mask);
+    });
+    double fusedMs = bestMs([&] { imgPipeline.apply(chain, input, fused); });
+    std::cout << std::fixed << std::setprecision(2)
+              << "5 op chain 1920x1080: separate " << separateMs << "ms"
+              << ", fused " << fusedMs << "ms"
+              << ", speedup " << separateMs / fusedMs << "x"
+              << std::scientific << ", max diff " << maxDifference(separate, fused)
+              << std::endl;
+}
+
+/************************************************************************
+* Whole-frame evaluate() against tiled render() of the same graph, and a
+* viewport-sized crop. The grade and mask are animated, so every frame
+* recomputes every node.
+************************************************************************/
+void tileBenchmark()
+{
+    Image plate;
+    fillTestImage(plate, 1920, 1080);
+    NodeGraph graph(1920, 1080);
+    NodeId plateNode = graph.add(std::make_unique<ImageNode>(plate));
+    NodeId graded = graph.add(std::make_unique<PointNode>([](PointChain& chain, int frame)
+    {
+        chain.scaleBrightness(1.0f + 0.01f * frame).colorTint(col4f(1.0f, 0.5f, 0.0f, 0.3f));
+    }), { plateNode });
+    NodeId blurred = graph.add(std::make_unique<BlurNode>(21), { graded });
+    NodeId mask = graph.add(std::make_unique<MaskNode>(MaskShape::Circle, Curve([](int frame) { return 0.01f * frame; }), 30));
+    NodeId output = graph.add(std::make_unique<CompositeNode>(), { blurred, plateNode, mask });
+
+    int frame = 0;
+    Image whole;
+    double wholeMs = bestMs([&] { whole.read(graph.evaluate(output, ++frame)); });
+    std::cout << std::fixed << std::setprecision(2)
+              << "graph 1920x1080: evaluate " << wholeMs << "ms" << std::endl;
+    Image tiled;
+    for (int tileSize : { 64, 128, 256 })
+    {
+        double tiledMs = bestMs([&] { graph.render(output, frame, tiled, { 0, 0, 1920, 1080 }, tileSize); });
+        std::cout << std::fixed << std::setprecision(2)
+                  << "  render " << std::setw(3) << tileSize << " tiles " << tiledMs << "ms"
+                  << std::scientific << ", max diff " << maxDifference(whole, tiled)
+                  << std::endl;
+    }
+    Rect crop = { 720, 405, 1200, 675 };
+    double cropMs = bestMs([&] { graph.render(output, frame, tiled, crop); });
+    std::cout << std::fixed << std::setprecision(2)
+              << "  render 480x270 crop " << cropMs << "ms" << std::endl;
+}
+
+/************************************************************************
+* Blur, HSV, composite and drawImage on 1 thread up to every hardware
+* thread, doubling. Every run is checked against the 1 thread output,
+* which must match exactly.
+************************************************************************/
+void threadScalingBenchmark()
+{
+    ImagePipeline imgPipeline;
+    Image input;
+    Image background;
+    Image mask;
+    fillTestImage(input, 1920, 1080);
+    fillTestImage(background, 1920, 1080);
+    imgPipeline.toNegative(background, background);
+    imgPipeline.maskify(input, mask);
+    Viewport viewport(1920, 1080);
+    col4f_hsv_t hsv = { 30.0f, 1.2f, 0.9f, 1.0f };
+
+    struct Case
+    {
+        const char* name;
+        std::function<void(Image&)> run;
+        Image reference;
+        double singleMs;
+    };
+    std::vector<Case> cases;
+    cases.push_back({ "blur 21", [&](Image& out) { imgPipeline.gaussianBlur(input, out, 21); } });
+    cases.push_back({ "box blur 51", [&](Image& out) { imgPipeline.gaussianBlur(input, out, 51, BlurMode::Box); } });
+    cases.push_back({ "adjustHSV", [&](Image& out) { imgPipeline.adjustHSV(input, out, hsv); } });
+    cases.push_back({ "composite", [&](Image& out) { imgPipeline.composite(input, background, out, mask); } });
+    cases.push_back({ "drawImage", [&](Image& out)
+    {
+        viewport.clearColor(col4f(0.0f, 0.0f, 0.0f, 1.0f));
+        viewport.drawImage(input, { 0.8f, 0.8f }, 30.0f, { 0.1f, 0.0f });
+        out.read(viewport.viewport);
+    } });
+
+    int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < hardwareThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    Image output;
+    for (int threads : threadCounts)
+    {
+        setThreadCount(threads);
+        std::cout << threads << " threads:" << std::endl;
+        for (Case& c : cases)
+        {
+            double ms = bestMs([&] { c.run(output); });
+            if (threads == 1)
+            {
+                c.reference.read(output);
+                c.singleMs = ms;
+            }
+            std::cout << std::fixed << std::setprecision(2)
+                      << "  " << std::left << std::setw(12) << c.name << std::right
+                      << " " << ms << "ms, speedup " << c.singleMs / ms << "x"
+                      << std::scientific << ", max diff vs 1 thread " << maxDifference(c.reference, output)
+                      << std::endl;
+        }
+    }
+    setThreadCount(0);
+}
+
+/************************************************************************
+* PNG round trip against each .cfr pixel type and compression, with
+* file size and the round trip error. Writes to the working directory.
+************************************************************************/
+void frameFileBenchmark()
+{
+    Image input;
+    fillTestImage(input, 1920, 1080);
+    Image output;
+    auto fileSize = [](const char* filename)
+    {
+        FILE* file = std::fopen(filename, "rb");
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fclose(file);
+        return size / (1024.0 * 1024.0);
+    };
+
+    double writeMs = bestMs([&] { input.write("benchmark.png"); }, 1);
+    double readMs = bestMs([&] { output.read("benchmark.png"); }, 1);
+    std::cout << std::fixed << std::setprecision(2)
+              << "png      write " << writeMs << "ms, read " << readMs << "ms, "
+              << fileSize("benchmark.png") << "MB"
+              << std::scientific << ", max diff " << maxDifference(input, output)
+              << std::endl;
+    std::remove("benchmark.png");
+
+    const char* pixelNames[] = { "f32", "f16" };
+    const char* compressionNames[] = { "none", "lz" };
+    for (FramePixel pixel : { FramePixel::Float32, FramePixel::Float16 })
+    {
+        for (FrameCompression compression : { FrameCompression::None, FrameCompression::LZ })
+        {
+            writeMs = bestMs([&] { writeFrame("benchmark.cfr", input, pixel, compression); });
+            readMs = bestMs([&] { readFrame("benchmark.cfr", output); });
+            std::cout << std::fixed << std::setprecision(2)
+                      << "cfr " << pixelNames[int(pixel)] << " " << std::setw(4) << compressionNames[int(compression)]
+                      << " write " << writeMs << "ms, read " << readMs << "ms, "
+                      << fileSize("benchmark.cfr") << "MB"
+                      << std::scientific << ", max diff " << maxDifference(input, output)
+                      << std::endl;
+        }
+    }
+    std::remove("benchmark.cfr");
+}
+
+/************************************************************************
+* processFrame against the original gather, over a 12 frame 1080p clip
+* with a smooth perlin mask and a per-pixel noise mask, then the same in
+* Blended mode.
+************************************************************************/
+void temporalBenchmark()
+{
+    const int frames = 12;
+    TemporalSampler sampler;
+    sampler.inputFrames.resize(frames);
+    sampler.outputFrames.resize(frames);
+    for (int i = 0; i < frames; i++)
+    {
+        sampler.inputFrames[i].resize(1920, 1080);
+        sampler.inputFrames[i].clearColor(col4f(float(i) / frames, 0.0f, 0.0f, 1.0f));
+        sampler.outputFrames[i].resize(1920, 1080);
+        sampler.inputs.push_back(view(sampler.inputFrames[i]));
+        sampler.outputs.push_back(view(sampler.outputFrames[i]));
+    }
+    sampler.width = 1920;
+    sampler.height = 1080;
+    std::vector<Image> reference(frames, Image(1920, 1080));
+
+    ImagePipeline pipeline;
+    Image perlin;
+    pipeline.perlinNoiseMask(perlin, 5.0f, 0.5f, 1920, 1080);
+    Image noise;
+    fillTestImage(noise, 1920, 1080);
+    for (int i = 0; i < noise.pixelCount; i++)
+    {
+        noise[i].a = noise[i].b;
+    }
+
+    const char* names[] = { "perlin", "noise" };
+    const Image* masks[] = { &perlin, &noise };
+    for (int m = 0; m < 2; m++)
+    {
+        const Image& mask = *masks[m];
+        double referenceMs = bestMs([&] { referenceTemporalSample(sampler.inputFrames, reference, 0, 0, frames - 1, mask); }, 1);
+        sampler.mode = TemporalMode::Nearest;
+        double sampleMs = bestMs([&] { sampler.processFrame(0, 0, frames - 1, mask); });
+        float diff = maxDifference(reference[0], sampler.outputFrames[0]);
+        sampler.mode = TemporalMode::Blended;
+        double blendedMs = bestMs([&] { sampler.processFrame(0, 0, frames - 1, mask); });
+        std::cout << std::fixed << std::setprecision(2)
+                  << "temporal " << std::setw(6) << names[m] << " mask: reference " << referenceMs << "ms, "
+                  << "processFrame " << sampleMs << "ms, blended " << blendedMs << "ms"
+                  << std::scientific << ", max diff " << diff
+                  << std::endl;
+    }
+}
+
+/************************************************************************
+* A graded chain and a composite over float and half storage. Half
+* inputs are rounded from the float ones, so the diff is the half
+* rounding of the results, relative to their size.
+************************************************************************/
+void halfBenchmark()
+{
+    ImagePipeline pipeline;
+    Image input;
+    fillTestImage(input, 1920, 1080);
+    Image background;
+    background.resize(1920, 1080);
+    background.clearColor(col4f(0.2f, 0.3f, 0.4f, 1.0f));
+    Image mask;
+    pipeline.circleMask(mask, 0.5f, 100, 1920, 1080);
+
+    HalfImage halfInput;
+    halfInput.read(input);
+    HalfImage halfBackground;
+    halfBackground.read(background);
+    HalfImage halfMask;
+    halfMask.read(mask);
+
+    PointChain chain;
+    chain.scaleBrightness(4.0f).adjustHSV({ 30.0f, 0.8f, 1.0f, 1.0f }).colorTint(col4f(1.0f, 0.5f, 0.0f, 0.3f));
+
+    Image output;
+    HalfImage halfOutput;
+    Image widened;
+    double floatMs = bestMs([&] { pipeline.apply(chain, input, output); });
+    double halfMs = bestMs([&] { pipeline.apply(chain, halfInput, halfOutput); });
+    halfOutput.write(widened);
+    std::cout << std::fixed << std::setprecision(2)
+              << "chain      float " << floatMs << "ms, half " << halfMs << "ms"
+              << std::scientific << ", max diff " << maxDifference(output, widened)
+              << std::endl;
+
+    floatMs = bestMs([&] { pipeline.composite(input, background, output, mask); });
+    halfMs = bestMs([&] { pipeline.composite(halfInput, halfBackground, halfOutput, halfMask); });
+    halfOutput.write(widened);
+    std::cout << std::fixed << std::setprecision(2)
+              << "composite  float " << floatMs << "ms, half " << halfMs << "ms"
+              << std::scientific << ", max diff " << maxDifference(output, widened)
+              << std::endl;
+
+    // Bloom wants values past 1, so both run on the plate brightened 4x.
+    // Through half first, so the threshold sees the same pixels.
+    Image hdr;
+    pipeline.scaleBrightness(input, hdr, 4.0f);
+    HalfImage halfHdr;
+    halfHdr.read(hdr);
+    halfHdr.write(hdr);
+    floatMs = bestMs([&] { pipeline.gaussianBlur(hdr, output, 25); });
+    halfMs = bestMs([&] { pipeline.gaussianBlur(halfHdr, halfOutput, 25); });
+    halfOutput.write(widened);
+    std::cout << std::fixed << std::setprecision(2)
+              << "blur 25    float " << floatMs << "ms, half " << halfMs << "ms"
+              << std::scientific << ", max diff " << maxDifference(output, widened)
+              << std::endl;
+    floatMs = bestMs([&] { pipeline.bloom(hdr, output, 3.0f, 25, 0.5f); });
+    halfMs = bestMs([&] { pipeline.bloom(halfHdr, halfOutput, 3.0f, 25, 0.5f); });
+    halfOutput.write(widened);
+    std::cout << std::fixed << std::setprecision(2)
+              << "bloom 25   float " << floatMs << "ms, half " << halfMs << "ms"
+              << std::scientific << ", max diff " << maxDifference(output, widened)
+              << std::endl;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "frame size float " << input.buffer.size() * sizeof(col4f) / (1024.0 * 1024.0) << "MB, "
+              << "half " << halfInput.buffer.size() * sizeof(col4h) / (1024.0 * 1024.0) << "MB"
+              << std::endl;
+}
+
+/************************************************************************
+* Float ops against their 8-bit overloads on the same LDR plate, max
+* diff in 8-bit levels of the float result after colFtoI. Then the whole
+* file to file composite both ways, decode and encode included.
+************************************************************************/
+void byteBenchmark()
+{
+    ImagePipeline pipeline;
+    Image input;
+    fillTestImage(input, 1920, 1080);
+    Image background;
+    background.resize(1920, 1080);
+    background.clearColor(col4f(0.2f, 0.3f, 0.4f, 1.0f));
+    // Through 8 bits first, so both paths start from the same pixels
+    ByteImage byteInput;
+    byteInput.read(input);
+    byteInput.write(input);
+    ByteImage byteBackground;
+    byteBackground.read(background);
+
+    Image output;
+    Image mask;
+    ByteImage byteOutput;
+    ByteImage byteMask;
+    ByteImage quantized;
+    auto report = [&](const char* name, double floatMs, double byteMs)
+    {
+        quantized.read(output);
+        int levels = 0;
+        for (int i = 0; i < quantized.pixelCount; i++)
+        {
+            const col4i& a = quantized.buffer[i];
+            const col4i& b = byteOutput.buffer[i];
+            levels = std::max({ levels, std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b), std::abs(a.a - b.a) });
+        }
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::left << std::setw(15) << name << std::right
+                  << "float " << floatMs << "ms, byte " << byteMs << "ms"
+                  << ", max diff " << levels << " levels" << std::endl;
+    };
+
+    report("negative",
+           bestMs([&] { pipeline.toNegative(input, output); }),
+           bestMs([&] { pipeline.toNegative(byteInput, byteOutput); }));
+    report("threshold",
+           bestMs([&] { pipeline.threshold(input, output, 0.5f); }),
+           bestMs([&] { pipeline.threshold(byteInput, byteOutput, 0.5f); }));
+    report("thresholdColor",
+           bestMs([&] { pipeline.thresholdColor(input, output, 0.5f); }),
+           bestMs([&] { pipeline.thresholdColor(byteInput, byteOutput, 0.5f); }));
+    report("colorTint",
+           bestMs([&] { pipeline.colorTint(input, output, col4f(1.0f, 0.5f, 0.0f, 0.3f)); }),
+           bestMs([&] { pipeline.colorTint(byteInput, byteOutput, col4f(1.0f, 0.5f, 0.0f, 0.3f)); }));
+    report("maskify",
+           bestMs([&] { pipeline.maskify(input, output); }),
+           bestMs([&] { pipeline.maskify(byteInput, byteOutput); }));
+    report("horizontalMask",
+           bestMs([&] { pipeline.horizontalMask(output, 0.3f, 300, 1920, 1080); }),
+           bestMs([&] { pipeline.horizontalMask(byteOutput, 0.3f, 300, 1920, 1080); }));
+    report("verticalMask",
+           bestMs([&] { pipeline.verticalMask(output, 0.6f, 70, 1920, 1080); }),
+           bestMs([&] { pipeline.verticalMask(byteOutput, 0.6f, 70, 1920, 1080); }));
+    report("circleMask",
+           bestMs([&] { pipeline.circleMask(output, 0.5f, 100, 1920, 1080); }),
+           bestMs([&] { pipeline.circleMask(byteOutput, 0.5f, 100, 1920, 1080); }));
+    // Same mask for both, so the SIMD check below sees a full ramp
+    pipeline.horizontalMask(byteMask, 0.5f, 300, 1920, 1080);
+    byteMask.write(mask);
+    report("composite",
+           bestMs([&] { pipeline.composite(input, background, output, mask); }),
+           bestMs([&] { pipeline.composite(byteInput, byteBackground, byteOutput, byteMask); }));
+
+    // The SIMD table has to match the scalar one exactly
+    ByteImage scalar(1920, 1080);
+    ByteImage simd(1920, 1080);
+    bool same = true;
+    if (cpuHasAVX2())
+    {
+        const col4i* in = byteInput.buffer.data();
+        const col4i* bg = byteBackground.buffer.data();
+        const col4i* m = byteMask.buffer.data();
+        int count = byteInput.pixelCount;
+        for (const ByteKernels* kernels : { &scalarByteKernels(), &avx2ByteKernels() })
+        {
+            ByteImage& out = (kernels == &scalarByteKernels()) ? scalar : simd;
+            kernels->negative(in, out.buffer.data(), count);
+            kernels->threshold(out.buffer.data(), out.buffer.data(), count, 0.3f);
+            kernels->composite(in, out.buffer.data(), m, out.buffer.data(), count);
+            kernels->thresholdColor(out.buffer.data(), out.buffer.data(), count, 0.4f);
+            kernels->composite(out.buffer.data(), bg, in, out.buffer.data(), count);
+            kernels->colorTint(out.buffer.data(), out.buffer.data(), count, col4f(1.0f, 0.5f, 0.0f, 0.3f));
+            kernels->maskify(out.buffer.data(), out.buffer.data(), count);
+            same = same && std::memcmp(out.buffer.data(), scalar.buffer.data(), count * sizeof(col4i)) == 0;
+        }
+        std::cout << "scalar and avx2 byte kernels " << (same ? "match" : "DIFFER") << std::endl;
+    }
+
+    input.write("byte-benchmark-fg.png");
+    background.write("byte-benchmark-bg.png");
+    WipeMask wipe = { MaskShape::Circle, 0.5f, 100 };
+    double byteMs = bestMs([&] { pipeline.compositeFiles("byte-benchmark-fg.png", "byte-benchmark-bg.png", wipe, "byte-benchmark-out.png"); });
+    // A .cfr input isn't LDR, so the same call takes the float path. Its
+    // pixels are the PNG's, so the two outputs should differ by rounding.
+    writeFrame("byte-benchmark-fg.cfr", input);
+    double floatMs = bestMs([&] { pipeline.compositeFiles("byte-benchmark-fg.cfr", "byte-benchmark-bg.png", wipe, "byte-benchmark-float.png"); });
+    std::cout << std::fixed << std::setprecision(2)
+              << "compositeFiles float " << floatMs << "ms, byte " << byteMs << "ms" << std::endl;
+
+    ByteImage byteResult;
+    ByteImage floatResult;
+    int maxDiff = -1;
+    if (byteResult.read("byte-benchmark-out.png") && floatResult.read("byte-benchmark-float.png"))
+    {
+        maxDiff = 0;
+        const uint8_t* a = &byteResult.buffer[0].r;
+        const uint8_t* b = &floatResult.buffer[0].r;
+        for (int i = 0; i < byteResult.pixelCount * NUM_CHANNELS; i++)
+        {
+            maxDiff = std::max(maxDiff, std::abs(int(a[i]) - int(b[i])));
+        }
+    }
+    std::cout << "compositeFiles byte vs float, max difference " << maxDiff << " levels" << std::endl;
+    std::remove("byte-benchmark-fg.png");
+    std::remove("byte-benchmark-bg.png");
+    std::remove("byte-benchmark-fg.cfr");
+    std::remove("byte-benchmark-out.png");
+    std::remove("byte-benchmark-float.png");
+}
+
+/************************************************************************
+* drawImage from the Image against from its MipPyramid at shrinking
+* scales. Aliasing is measured on a one pixel checkerboard, which any
+* properly filtered minification draws as flat 0.5 grey, as the RMS
+* distance of the drawn pixels from that grey.
+************************************************************************/
+void mipBenchmark()
+{
+    Image plate;
+    fillTestImage(plate, 2048, 2048);
+    Image checker(2048, 2048);
+    for (int y = 0; y < checker.height; y++)
+    {
+        for (int x = 0; x < checker.width; x++)
+        {
+            float value = float((x + y) & 1);
+            checker(x, y) = col4f(value, value, value, 1.0f);
+        }
+    }
+    double buildMs = bestMs([&] { MipPyramid mips(plate); });
+    MipPyramid plateMips(plate);
+    MipPyramid checkerMips(checker);
+    std::cout << std::fixed << std::setprecision(2) << "pyramid build " << buildMs << "ms" << std::endl;
+
+    Viewport viewport(1920, 1080);
+    const col4f unset = col4f(-1.0f, -1.0f, -1.0f, -1.0f);
+    auto aliasing = [&]()
+    {
+        double sum = 0.0;
+        int drawn = 0;
+        for (int i = 0; i < viewport.viewport.pixelCount; i++)
+        {
+            float r = viewport.viewport[i].r;
+            if (r != unset.r)
+            {
+                sum += (r - 0.5) * (r - 0.5);
+                drawn++;
+            }
+        }
+        return drawn ? std::sqrt(sum / drawn) : 0.0;
+    };
+    for (float scale : { 0.5f, 0.25f, 0.1f })
+    {
+        vec2 size = { scale, scale };
+        double imageMs = bestMs([&] { viewport.drawImage(plate, size, 30.0f, { 0.1f, 0.0f }); });
+        double mipMs = bestMs([&] { viewport.drawImage(plateMips, size, 30.0f, { 0.1f, 0.0f }); });
+        viewport.clearColor(unset);
+        viewport.drawImage(checker, size, 30.0f, { 0.1f, 0.0f });
+        double imageAliasing = aliasing();
+        viewport.clearColor(unset);
+        viewport.drawImage(checkerMips, size, 30.0f, { 0.1f, 0.0f });
+        double mipAliasing = aliasing();
+        std::cout << std::fixed << std::setprecision(2)
+                  << "scale " << scale << "  bilinear " << imageMs << "ms, trilinear " << mipMs << "ms"
+                  << std::setprecision(3) << ", checker RMS " << imageAliasing << " -> " << mipAliasing
+                  << std::endl;
+    }
+}
+
+/************************************************************************
+* rotatingImageScene's frame, a screen filling sky with a sun and birds
+* over it, drawn call by call and as one layer list. Both must produce
+* the same frame.
+************************************************************************/
+void layerBenchmark()
+{
+    Image sky;
+    fillTestImage(sky, 2400, 1600);
+    Image sun;
+    fillTestImage(sun, 800, 800);
+    Image birds;
+    fillTestImage(birds, 600, 300);
+    // The sky stays opaque. The sun fades out from its center and the
+    // birds run from clear to solid, so Over has to blend them.
+    for (int y = 0; y < sun.height; y++)
+    {
+        for (int x = 0; x < sun.width; x++)
+        {
+            float dx = float(x - sun.width / 2) / float(sun.width / 2);
+            float dy = float(y - sun.height / 2) / float(sun.height / 2);
+            sun(x, y).a = clamp(1.0f - std::sqrt(dx * dx + dy * dy), 0.0f, 1.0f);
+        }
+    }
+    for (int y = 0; y < birds.height; y++)
+    {
+        for (int x = 0; x < birds.width; x++)
+        {
+            birds(x, y).a = float(x) / float(birds.width - 1);
+        }
+    }
+    MipPyramid skyMips(sky);
+    MipPyramid sunMips(sun);
+    MipPyramid birdsMips(birds);
+    col4f clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Over, a layer at a time: draw into a transparent scratch viewport
+    // then blend it down with the scalar kernel
+    Viewport scratch(1920, 1080);
+    const PixelKernels& scalar = scalarPixelKernels();
+    auto drawSeparate = [&](Viewport& target, const Layer& layer)
+    {
+        if (layer.blend == LayerBlend::Replace)
+        {
+            target.drawImage(*layer.mips, layer.scale, layer.rotation, layer.translation);
+            return;
+        }
+        scratch.clearColor(col4f(0.0f, 0.0f, 0.0f, 0.0f));
+        scratch.drawImage(*layer.mips, layer.scale, layer.rotation, layer.translation);
+        Image& below = target.viewport;
+        threadPool().parallelFor(below.pixelCount, 32 * 1024, [&](int begin, int end)
+        {
+            scalar.alphaOver(scratch.viewport.buffer.data() + begin, below.buffer.data() + begin,
+                             below.buffer.data() + begin, end - begin);
+        });
+    };
+
+    Viewport separate(1920, 1080);
+    Viewport layered(1920, 1080);
+    for (LayerBlend blend : { LayerBlend::Replace, LayerBlend::Over })
+    {
+        std::vector<Layer> layers = {
+            { nullptr, &skyMips, { 0.9f, 0.9f }, 0.0f, { 0.0f, 0.0f }, blend },
+            { nullptr, &sunMips, { 0.5f, 0.5f }, 30.0f, { 0.0f, 0.0f }, blend },
+            { nullptr, &birdsMips, { 0.3f, 0.3f }, 0.0f, { 0.3f, 0.1f }, blend }
+        };
+        double separateMs = bestMs([&]
+        {
+            separate.clearColor(clearColor);
+            for (const Layer& layer : layers)
+            {
+                drawSeparate(separate, layer);
+            }
+        });
+        double layeredMs = bestMs([&] { layered.drawLayers(layers, clearColor); });
+        std::cout << std::fixed << std::setprecision(2)
+                  << (blend == LayerBlend::Replace ? "replace" : "over   ")
+                  << "  drawImage x3 " << separateMs << "ms, drawLayers " << layeredMs << "ms"
+                  << std::scientific << ", max diff " << maxDifference(separate.viewport, layered.viewport)
+                  << std::endl;
+    }
+}
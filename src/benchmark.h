@@ -0,0 +1,41 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: benchmark.h
+ *
+ * Timing runs for ImagePipeline operations.
+ * Call these from main() in place of a scene.
+************************************************************************/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// gaussianBlur against the original x-outer/y-inner implementation
+void blurBenchmark();
+// BlurMode::Box against BlurMode::Exact, speed and error
+void blurModeBenchmark();
+// gaussianDeBlur speed and how much of a gaussianBlur it recovers
+void deblurBenchmark();
+// Image vs PlanarImage for the channel-wise ops
+void planarBenchmark();
+// Scalar vs AVX2 pixel kernels, throughput in Mpixels/s
+void pixelKernelBenchmark();
+// Separate ImagePipeline calls vs one fused PointChain
+void pointChainBenchmark();
+// NodeGraph whole-frame evaluate vs tiled render
+void tileBenchmark();
+// Blur, HSV, composite and drawImage from 1 thread to every core
+void threadScalingBenchmark();
+// PNG against the native .cfr frame format, speed, size and error
+void frameFileBenchmark();
+// TemporalSampler::processFrame against the original per-pixel gather
+void temporalBenchmark();
+// col4f against HalfImage storage for a chain and a composite
+void halfBenchmark();
+// col4f against ByteImage for the LDR-safe ops and a file to file composite
+void byteBenchmark();
+// drawImage bilinear against MipPyramid trilinear, speed and aliasing
+void mipBenchmark();
+// Clear plus three drawImage calls against one drawLayers pass
+void layerBenchmark();
+
+#endif
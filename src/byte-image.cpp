@@ -0,0 +1,343 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: byte-image.cpp
+ *
+ * ByteImage plus the 8-bit ImagePipeline
+ * overloads.
+ *******************************************/
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "byte-image.h"
+#include "byte-kernels.h"
+#include "frame-file.h"
+#include "image.h"
+#include "thread-pool.h"
+
+// Fewest pixels per thread pool chunk for the byte ops
+static const int BYTE_GRAIN = 32 * 1024;
+// Rows per thread pool chunk for the byte masks
+static const int MASK_ROWS = 8;
+
+ByteImage::ByteImage()
+{
+    this->width = 0;
+    this->height = 0;
+    this->aspectRatio = 1.0f;
+    this->pixelCount = 0;
+}
+
+ByteImage::ByteImage(int width, int height)
+{
+    this->resize(width, height);
+}
+
+void ByteImage::resize(int width, int height)
+{
+    if (width >= 0 && height >= 0)
+    {
+        this->width = width;
+        this->height = height;
+        this->aspectRatio = float(width) / float(height);
+        this->pixelCount = width * height;
+        buffer.resize(pixelCount);
+    }
+}
+
+bool ByteImage::read(const char* filename)
+{
+    int newWidth;
+    int newHeight;
+    int nrChannels;
+    unsigned char* data = stbi_load(filename, &newWidth, &newHeight, &nrChannels, NUM_CHANNELS);
+    if (!data)
+    {
+        std::cerr << "ERROR: STBI Failed to load the image" << std::endl;
+        return false;
+    }
+    resize(newWidth, newHeight);
+    std::memcpy(buffer.data(), data, size_t(pixelCount) * sizeof(col4i));
+    stbi_image_free(data);
+    return true;
+}
+
+bool ByteImage::write(const char* filename) const
+{
+    if (!stbi_write_png(filename, width, height, NUM_CHANNELS, buffer.data(), width * sizeof(col4i)))
+    {
+        std::cerr << "ERROR: STBI Failed to write the image" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ByteImage::read(const Image& image)
+{
+    resize(image.width, image.height);
+    threadPool().parallelFor(pixelCount, BYTE_GRAIN, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            buffer[i] = colFtoI(image.buffer[i]);
+        }
+    });
+}
+
+void ByteImage::write(Image& image) const
+{
+    image.resize(width, height);
+    threadPool().parallelFor(pixelCount, BYTE_GRAIN, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            image.buffer[i] = colItoF(buffer[i]);
+        }
+    });
+}
+
+bool isLdrImageFile(const char* filename)
+{
+    int width;
+    int height;
+    int channels;
+    return !isFrameFile(filename)
+        && stbi_info(filename, &width, &height, &channels)
+        && !stbi_is_hdr(filename)
+        && !stbi_is_16_bit(filename);
+}
+
+/************************************************************************
+* 8-bit ImagePipeline ops. Each runs one ByteKernels entry over chunks
+* of the image on the thread pool.
+************************************************************************/
+template <typename F>
+static void parallelBytes(const ByteImage& in, ByteImage& out, F&& span)
+{
+    out.resize(in.width, in.height);
+    threadPool().parallelFor(in.pixelCount, BYTE_GRAIN, [&](int begin, int end)
+    {
+        span(in.buffer.data() + begin, out.buffer.data() + begin, end - begin);
+    });
+}
+
+void ImagePipeline::toNegative(const ByteImage& in, ByteImage& out)
+{
+    parallelBytes(in, out, byteKernels().negative);
+}
+
+void ImagePipeline::colorTint(const ByteImage& in, ByteImage& out, col4f tint)
+{
+    parallelBytes(in, out, [&](const col4i* src, col4i* dst, int count)
+    {
+        byteKernels().colorTint(src, dst, count, tint);
+    });
+}
+
+void ImagePipeline::threshold(const ByteImage& in, ByteImage& out, float threshold)
+{
+    parallelBytes(in, out, [&](const col4i* src, col4i* dst, int count)
+    {
+        byteKernels().threshold(src, dst, count, threshold);
+    });
+}
+
+void ImagePipeline::thresholdColor(const ByteImage& in, ByteImage& out, float threshold)
+{
+    parallelBytes(in, out, [&](const col4i* src, col4i* dst, int count)
+    {
+        byteKernels().thresholdColor(src, dst, count, threshold);
+    });
+}
+
+void ImagePipeline::maskify(const ByteImage& imgIn, ByteImage& maskOut)
+{
+    parallelBytes(imgIn, maskOut, byteKernels().maskify);
+}
+
+void ImagePipeline::composite(const ByteImage& imgIn1, const ByteImage& imgIn2, ByteImage& imgOut, const ByteImage& mask)
+{
+    imgOut.resize(imgIn1.width, imgIn1.height);
+    const ByteKernels& kernels = byteKernels();
+    threadPool().parallelFor(imgIn1.pixelCount, BYTE_GRAIN, [&](int begin, int end)
+    {
+        kernels.composite(imgIn1.buffer.data() + begin, imgIn2.buffer.data() + begin, mask.buffer.data() + begin,
+                          imgOut.buffer.data() + begin, end - begin);
+    });
+}
+
+/************************************************************************
+* The wipe masks are drawn straight into 8 bits. A level is what
+* colFtoI makes of the float mask, 255.99 * clamp(v, 0, 1) truncated.
+* The linear ramps are stepped in 16.16 fixed point, once per row or
+* column, and the circle compares integer squared distances against the
+* squared radius each level starts at. No pixel goes through float.
+************************************************************************/
+static const int FIXED_SHIFT = 16;
+
+// Level at each of count steps of the ramp (i - cutoff) / feathering + 0.5
+static void rampLevels(std::vector<uint8_t>& levels, int count, int cutoff, int feathering)
+{
+    double scale = double(1 << FIXED_SHIFT) * 255.99;
+    int64_t level = std::llround(scale * (0.5 - double(cutoff) / feathering));
+    int64_t step = std::llround(scale / feathering);
+    levels.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        levels[i] = uint8_t(std::clamp<int64_t>(level >> FIXED_SHIFT, 0, 255));
+        level += step;
+    }
+}
+
+void ImagePipeline::horizontalMask(ByteImage& maskOut, float t, int feathering, int width, int height)
+{
+    maskOut.resize(width, height);
+    int cutoff = clamp(int(float(width) * t), 0, width);
+    std::vector<uint8_t> levels;
+    rampLevels(levels, width, cutoff, feathering);
+    threadPool().parallelFor(height, MASK_ROWS, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            col4i* row = &maskOut(0, y);
+            for (int x = 0; x < width; x++)
+            {
+                row[x] = { 0, 0, 0, levels[x] };
+            }
+        }
+    });
+}
+
+void ImagePipeline::verticalMask(ByteImage& maskOut, float t, int feathering, int width, int height)
+{
+    maskOut.resize(width, height);
+    int cutoff = clamp(int(float(height) * t), 0, height);
+    std::vector<uint8_t> levels;
+    rampLevels(levels, height, cutoff, feathering);
+    threadPool().parallelFor(height, MASK_ROWS, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            std::fill(&maskOut(0, y), &maskOut(0, y) + width, col4i { 0, 0, 0, levels[y] });
+        }
+    });
+}
+
+void ImagePipeline::circleMask(ByteImage& maskOut, float t, int feathering, int width, int height)
+{
+    maskOut.resize(width, height);
+    int centerX = width / 2;
+    int centerY = height / 2;
+    float finalRadius = sqrt(width * width + height * height) / 2.0f;
+    int cutoff = clamp(finalRadius * t, 0.0f, finalRadius);
+
+    // Level k starts where (d - cutoff) / feathering + 0.5 reaches
+    // k / 255.99, at a squared distance of starts[k] or more
+    int64_t starts[257];
+    starts[0] = 0;
+    for (int k = 1; k < 256; k++)
+    {
+        double radius = cutoff + feathering * (k / 255.99 - 0.5);
+        starts[k] = radius <= 0.0 ? 0 : int64_t(std::ceil(radius * radius));
+    }
+    starts[256] = INT64_MAX;
+
+    int reach = std::max(centerX + 1, width - centerX);
+    threadPool().parallelFor(height, MASK_ROWS, [&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            // Walk out from the center column, both sides at once
+            col4i* row = &maskOut(0, y);
+            int64_t dy = y - centerY;
+            int64_t distance = dy * dy;
+            int level = 0;
+            for (int dx = 0; dx < reach; dx++)
+            {
+                while (starts[level + 1] <= distance)
+                {
+                    level++;
+                }
+                col4i pixel = { 0, 0, 0, uint8_t(level) };
+                if (centerX + dx < width)
+                {
+                    row[centerX + dx] = pixel;
+                }
+                if (centerX - dx >= 0)
+                {
+                    row[centerX - dx] = pixel;
+                }
+                distance += 2 * dx + 1;
+            }
+        }
+    });
+}
+
+/************************************************************************
+* One frame of a wipe. Everything in it is LDR safe, so when the files
+* are too the frame never leaves 8 bits, from decode through the mask
+* and composite to encode. Otherwise it runs in float as before. Both
+* paths draw the same clamped mask, so only rounding tells them apart.
+************************************************************************/
+template <typename T>
+static bool drawWipeMask(ImagePipeline& pipeline, const WipeMask& wipe, T& mask, int width, int height)
+{
+    if (!wipe.file.empty())
+    {
+        if (!mask.read(wipe.file.c_str()))
+        {
+            return false;
+        }
+        pipeline.maskify(mask, mask);
+        return true;
+    }
+    switch (wipe.shape)
+    {
+        case MaskShape::Horizontal:
+            pipeline.horizontalMask(mask, wipe.t, wipe.feathering, width, height);
+            break;
+        case MaskShape::Vertical:
+            pipeline.verticalMask(mask, wipe.t, wipe.feathering, width, height);
+            break;
+        case MaskShape::Circle:
+            pipeline.circleMask(mask, wipe.t, wipe.feathering, width, height);
+            break;
+    }
+    return true;
+}
+
+template <typename T>
+static bool compositeWipe(ImagePipeline& pipeline, const char* fg, const char* bg, const WipeMask& wipe, const char* out,
+                          T& fgImage, T& bgImage, T& mask)
+{
+    if (!fgImage.read(fg) || !bgImage.read(bg)
+        || !drawWipeMask(pipeline, wipe, mask, fgImage.width, fgImage.height))
+    {
+        return false;
+    }
+    if (bgImage.width != fgImage.width || bgImage.height != fgImage.height
+        || mask.width != fgImage.width || mask.height != fgImage.height)
+    {
+        std::cerr << "ERROR: " << fg << " is " << fgImage.width << "x" << fgImage.height
+                  << ", but " << bg << " is " << bgImage.width << "x" << bgImage.height
+                  << " and the mask " << mask.width << "x" << mask.height << std::endl;
+        return false;
+    }
+    pipeline.composite(fgImage, bgImage, fgImage, mask);
+    return fgImage.write(out);
+}
+
+bool ImagePipeline::compositeFiles(const char* fg, const char* bg, const WipeMask& mask, const char* out)
+{
+    bool ldr = isLdrImageFile(fg) && isLdrImageFile(bg)
+        && (mask.file.empty() || isLdrImageFile(mask.file.c_str()))
+        && !isFrameFile(out);
+    if (ldr)
+    {
+        return compositeWipe(*this, fg, bg, mask, out, byteTemp1, byteTemp2, byteTemp3);
+    }
+    return compositeWipe(*this, fg, bg, mask, out, temp1, temp2, temp3);
+}
@@ -0,0 +1,53 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: byte-image.h
+ *
+ * Image stored as 8-bit RGBA, 4 bytes a pixel instead of 16. PNGs and
+ * JPEGs decode straight into it and encode straight out of it, with no
+ * trip through float. Only for LDR work, values clamp to [0, 1] on the
+ * way in, so brightness past 1 and anything HDR keeps using Image.
+************************************************************************/
+
+#ifndef BYTE_IMAGE_H
+#define BYTE_IMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "color.h"
+
+class Image;
+
+class ByteImage
+{
+public:
+    std::vector<col4i> buffer;
+    int width;
+    int height;
+    float aspectRatio;
+
+    int pixelCount; // Current image size
+
+    ByteImage();
+    ByteImage(int width, int height);
+    void resize(int width, int height);
+    bool read(const char* filename); // 8-bit file, no float conversion
+    bool write(const char* filename) const; // PNG
+
+    // Conversion points, clamping and truncating like Image::write
+    void read(const Image& image); // float -> byte
+    void write(Image& image) const; // byte -> float
+
+    inline col4i& operator()(size_t x, size_t y) noexcept {
+        return buffer[y * width + x];
+    }
+    inline const col4i& operator()(size_t x, size_t y) const noexcept {
+        return buffer[y * width + x];
+    }
+};
+
+// True for image files that hold nothing a ByteImage would lose,
+// 8 bits per channel and not HDR or a .cfr frame
+bool isLdrImageFile(const char* filename);
+
+#endif
@@ -0,0 +1,301 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: byte-kernels.cpp
+ *
+ * AVX2 kernels work on eight col4i pixels
+ * per 256-bit register, widening to 16-bit
+ * lanes where products need the room.
+ *******************************************/
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include "byte-kernels.h"
+#include "pixel-kernels.h"
+
+// x / 255 rounded to nearest, exact for 0 <= x <= 255 * 255
+static inline int div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// avg > threshold as an integer compare on r + g + b
+static inline int sumThreshold(float threshold)
+{
+    return int(std::clamp(std::floor(765.0f * threshold), -1.0f, 765.0f));
+}
+
+// (r + g + b) / 3 rounded, the multiply is exact for sums up to 765
+static inline int average3(int sum)
+{
+    return ((sum + 1) * 21846) >> 16;
+}
+
+/************************************************************************
+* Scalar kernels, the reference behavior for every op.
+************************************************************************/
+static void scalarNegative(const col4i* in, col4i* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = { uint8_t(255 - in[i].r), uint8_t(255 - in[i].g), uint8_t(255 - in[i].b), in[i].a };
+    }
+}
+
+static void scalarThreshold(const col4i* in, col4i* out, int count, float threshold)
+{
+    int limit = sumThreshold(threshold);
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t value = (in[i].r + in[i].g + in[i].b > limit) ? 255 : 0;
+        out[i] = { value, value, value, value };
+    }
+}
+
+static void scalarThresholdColor(const col4i* in, col4i* out, int count, float threshold)
+{
+    int limit = sumThreshold(threshold);
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = (in[i].r + in[i].g + in[i].b > limit) ? in[i] : col4i { 0, 0, 0, 0 };
+    }
+}
+
+static void scalarMaskify(const col4i* in, col4i* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = { 0, 0, 0, uint8_t(average3(in[i].r + in[i].g + in[i].b)) };
+    }
+}
+
+// Alpha comes from in1, like the float composite
+static void scalarComposite(const col4i* in1, const col4i* in2, const col4i* mask, col4i* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int m = mask[i].a;
+        out[i] = {
+            uint8_t(div255(in1[i].r * m + in2[i].r * (255 - m))),
+            uint8_t(div255(in1[i].g * m + in2[i].g * (255 - m))),
+            uint8_t(div255(in1[i].b * m + in2[i].b * (255 - m))),
+            in1[i].a
+        };
+    }
+}
+
+/************************************************************************
+* blendOver with a constant tint. Its output alpha and divisor only
+* depend on the background's blue, as the float version has it, so
+* both come from 256 entry tables and each channel is one fused
+* multiply-add, done with std::fma so the AVX2 version matches.
+************************************************************************/
+struct TintTables
+{
+    float tinted[3][256];
+    float scale[256];
+    int alpha[256];
+
+    TintTables(col4f tint)
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            float aOut = std::clamp(tint.a + (b / 255.0f) * (1.0f - tint.a), 0.001f, 1.0f);
+            tinted[0][b] = 255.0f * tint.r * tint.a / aOut + 0.5f;
+            tinted[1][b] = 255.0f * tint.g * tint.a / aOut + 0.5f;
+            tinted[2][b] = 255.0f * tint.b * tint.a / aOut + 0.5f;
+            scale[b] = (1.0f - tint.a) / (255.0f * aOut);
+            alpha[b] = int(255.99f * aOut);
+        }
+    }
+};
+
+// Already offset by 0.5, so truncating rounds
+static inline uint8_t tintChannel(float weight, int value, float tinted)
+{
+    return uint8_t(std::min(std::max(std::fma(weight, float(value), tinted), 0.0f), 255.0f));
+}
+
+static void tintSpan(const TintTables& tables, const col4i* in, col4i* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int b = in[i].b;
+        float weight = tables.scale[b] * float(in[i].a);
+        out[i] = {
+            tintChannel(weight, in[i].r, tables.tinted[0][b]),
+            tintChannel(weight, in[i].g, tables.tinted[1][b]),
+            tintChannel(weight, in[i].b, tables.tinted[2][b]),
+            uint8_t(tables.alpha[b])
+        };
+    }
+}
+
+static void scalarColorTint(const col4i* in, col4i* out, int count, col4f tint)
+{
+    tintSpan(TintTables(tint), in, out, count);
+}
+
+/************************************************************************
+* AVX2 kernels. Compiled for AVX2 regardless of the global flags, only
+* ever called after cpuHasAVX2(). Pixels past the last multiple of 8
+* go through the scalar kernel.
+************************************************************************/
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static inline __m256i load8(const col4i* p) { return _mm256_loadu_si256((const __m256i*) p); }
+AVX2 static inline void store8(col4i* p, __m256i v) { _mm256_storeu_si256((__m256i*) p, v); }
+
+// Byte 3 of every pixel, its alpha
+AVX2 static inline __m256i alphaBytes() { return _mm256_set1_epi32(int(0xFF000000)); }
+
+// r + g + b of each pixel in its 32-bit lane
+AVX2 static inline __m256i sum3(__m256i v)
+{
+    __m256i pairs = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x00010101));
+    return _mm256_madd_epi16(pairs, _mm256_set1_epi16(1));
+}
+
+// x / 255 rounded, per 16-bit lane
+AVX2 static inline __m256i div255x16(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+AVX2 static void avx2ColorTint(const col4i* in, col4i* out, int count, col4f tint)
+{
+    const TintTables tables(tint);
+    const __m256i low = _mm256_set1_epi32(0xFF);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 full = _mm256_set1_ps(255.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = load8(in + i);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 16), low);
+        __m256 weight = _mm256_mul_ps(_mm256_i32gather_ps(tables.scale, b, 4), _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24)));
+        __m256i result = _mm256_slli_epi32(_mm256_i32gather_epi32(tables.alpha, b, 4), 24);
+        for (int c = 0; c < 3; c++)
+        {
+            __m256 value = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8 * c), low));
+            __m256 mixed = _mm256_fmadd_ps(weight, value, _mm256_i32gather_ps(tables.tinted[c], b, 4));
+            __m256i channel = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(mixed, zero), full));
+            result = _mm256_or_si256(result, _mm256_slli_epi32(channel, 8 * c));
+        }
+        store8(out + i, result);
+    }
+    tintSpan(tables, in + i, out + i, count - i);
+}
+
+AVX2 static void avx2Negative(const col4i* in, col4i* out, int count)
+{
+    const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        store8(out + i, _mm256_xor_si256(load8(in + i), rgb));
+    }
+    scalarNegative(in + i, out + i, count - i);
+}
+
+AVX2 static void avx2Threshold(const col4i* in, col4i* out, int count, float threshold)
+{
+    const __m256i limit = _mm256_set1_epi32(sumThreshold(threshold));
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        store8(out + i, _mm256_cmpgt_epi32(sum3(load8(in + i)), limit));
+    }
+    scalarThreshold(in + i, out + i, count - i, threshold);
+}
+
+AVX2 static void avx2ThresholdColor(const col4i* in, col4i* out, int count, float threshold)
+{
+    const __m256i limit = _mm256_set1_epi32(sumThreshold(threshold));
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = load8(in + i);
+        store8(out + i, _mm256_and_si256(v, _mm256_cmpgt_epi32(sum3(v), limit)));
+    }
+    scalarThresholdColor(in + i, out + i, count - i, threshold);
+}
+
+AVX2 static void avx2Maskify(const col4i* in, col4i* out, int count)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i third = _mm256_set1_epi32(21846);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i average = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_add_epi32(sum3(load8(in + i)), one), third), 16);
+        store8(out + i, _mm256_slli_epi32(average, 24));
+    }
+    scalarMaskify(in + i, out + i, count - i);
+}
+
+AVX2 static void avx2Composite(const col4i* in1, const col4i* in2, const col4i* mask, col4i* out, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    // Each pixel's alpha byte copied across its four bytes
+    const __m256i spread = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                            3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i fg = load8(in1 + i);
+        __m256i bg = load8(in2 + i);
+        __m256i m = _mm256_shuffle_epi8(load8(mask + i), spread);
+
+        __m256i mLo = _mm256_unpacklo_epi8(m, zero);
+        __m256i mHi = _mm256_unpackhi_epi8(m, zero);
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(fg, zero), mLo),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(bg, zero), _mm256_sub_epi16(full, mLo)));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(fg, zero), mHi),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(bg, zero), _mm256_sub_epi16(full, mHi)));
+        __m256i mixed = _mm256_packus_epi16(div255x16(lo), div255x16(hi));
+        store8(out + i, _mm256_blendv_epi8(mixed, fg, alphaBytes()));
+    }
+    scalarComposite(in1 + i, in2 + i, mask + i, out + i, count - i);
+}
+
+static const ByteKernels scalarKernels =
+{
+    "scalar",
+    scalarNegative,
+    scalarThreshold,
+    scalarThresholdColor,
+    scalarMaskify,
+    scalarComposite,
+    scalarColorTint
+};
+
+static const ByteKernels avx2Kernels =
+{
+    "avx2",
+    avx2Negative,
+    avx2Threshold,
+    avx2ThresholdColor,
+    avx2Maskify,
+    avx2Composite,
+    avx2ColorTint
+};
+
+const ByteKernels& scalarByteKernels()
+{
+    return scalarKernels;
+}
+
+const ByteKernels& avx2ByteKernels()
+{
+    return avx2Kernels;
+}
+
+const ByteKernels& byteKernels()
+{
+    static const ByteKernels& selected = cpuHasAVX2() ? avx2Kernels : scalarKernels;
+    return selected;
+}
@@ -0,0 +1,34 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: byte-kernels.h
+ *
+ * Per-pixel ops over spans of 8-bit col4i, for LDR images that never
+ * need to leave integer. Math is fixed point with rounding, except
+ * colorTint, which divides by a per-pixel alpha and stays in float.
+ * Results land within one level of the float op followed by colFtoI.
+ * Like the float kernels, the AVX2 table is picked at runtime and the
+ * scalar table is the reference it matches bit for bit.
+************************************************************************/
+
+#ifndef BYTE_KERNELS_H
+#define BYTE_KERNELS_H
+
+#include "color.h"
+
+// One entry per op. in and out may be the same span.
+struct ByteKernels
+{
+    const char* name;
+    void (*negative)(const col4i* in, col4i* out, int count);
+    void (*threshold)(const col4i* in, col4i* out, int count, float threshold);
+    void (*thresholdColor)(const col4i* in, col4i* out, int count, float threshold);
+    void (*maskify)(const col4i* in, col4i* out, int count);
+    void (*composite)(const col4i* in1, const col4i* in2, const col4i* mask, col4i* out, int count);
+    void (*colorTint)(const col4i* in, col4i* out, int count, col4f tint);
+};
+
+const ByteKernels& scalarByteKernels();
+const ByteKernels& avx2ByteKernels(); // Only call when cpuHasAVX2()
+const ByteKernels& byteKernels(); // Best table for this CPU
+
+#endif
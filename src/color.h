@@ -10,6 +10,7 @@
 #define COLOR_H
 
 #include <cmath>
+#include <cstdint>
 #include <numbers>
 #include "math.h"
 
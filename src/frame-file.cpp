@@ -0,0 +1,563 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: frame-file.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "frame-file.h"
+#include "half-float.h"
+#include "thread-pool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Shortest match worth a 3 byte token and offset
+static const int LZ_MIN_MATCH = 4;
+static const int LZ_HASH_BITS = 14;
+static const int LZ_MAX_OFFSET = 65535;
+// Most output one input byte can decode to, a 255 length byte
+static const uint64_t LZ_MAX_EXPANSION = 255;
+
+/************************************************************************
+* Memory mapping.
+************************************************************************/
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+    return map(filename, 0, false);
+}
+
+bool MappedFile::create(const char* filename, size_t size)
+{
+    return size > 0 && map(filename, size, true);
+}
+
+#ifdef _WIN32
+// size 0 maps an existing file whole
+bool MappedFile::map(const char* filename, size_t size, bool write)
+{
+    close();
+    HANDLE handle = CreateFileA(filename, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+        write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = LONGLONG(size);
+    if (!write && (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0))
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE map = CreateFileMappingA(handle, nullptr, write ? PAGE_READWRITE : PAGE_READONLY,
+        DWORD(fileSize.QuadPart >> 32), DWORD(fileSize.QuadPart), nullptr);
+    if (map == nullptr)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    bytes = (uint8_t*) MapViewOfFile(map, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if (bytes == nullptr)
+    {
+        CloseHandle(map);
+        CloseHandle(handle);
+        return false;
+    }
+    file = handle;
+    mapping = map;
+    length = size_t(fileSize.QuadPart);
+    writable = write;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes != nullptr)
+    {
+        UnmapViewOfFile(bytes);
+        CloseHandle((HANDLE) mapping);
+        CloseHandle((HANDLE) file);
+    }
+    bytes = nullptr;
+    length = 0;
+    writable = false;
+}
+#else
+// size 0 maps an existing file whole
+bool MappedFile::map(const char* filename, size_t size, bool write)
+{
+    close();
+    int fd = write ? ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (write && ftruncate(fd, off_t(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, size_t(info.st_size), write ? PROT_READ | PROT_WRITE : PROT_READ,
+        write ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference to the file
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    bytes = (uint8_t*) map;
+    length = size_t(info.st_size);
+    writable = write;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes != nullptr)
+    {
+        munmap(bytes, length);
+    }
+    bytes = nullptr;
+    length = 0;
+    writable = false;
+}
+#endif
+
+/************************************************************************
+* Byte shuffle. Splits elements of size bytes into size planes, so the
+* sign and exponent bytes of neighbouring pixels, which rarely change,
+* end up next to each other where LZ can find the runs.
+************************************************************************/
+static void shuffleBytes(const uint8_t* in, uint8_t* out, size_t count, int size)
+{
+    for (int k = 0; k < size; k++)
+    {
+        uint8_t* plane = out + k * count;
+        for (size_t i = 0; i < count; i++)
+        {
+            plane[i] = in[i * size + k];
+        }
+    }
+}
+
+static void unshuffleBytes(const uint8_t* in, uint8_t* out, size_t count, int size)
+{
+    for (int k = 0; k < size; k++)
+    {
+        const uint8_t* plane = in + k * count;
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i * size + k] = plane[i];
+        }
+    }
+}
+
+/************************************************************************
+* LZ in the style of LZ4's block format. Each sequence is a token byte,
+* literal length in the high nibble and match length - 4 in the low,
+* 15 meaning more length bytes follow, then the literals, then a 2 byte
+* offset back to the match. The last sequence is literals only.
+************************************************************************/
+static void putLength(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(uint8_t(length));
+}
+
+static void putSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t matchLength, size_t offset)
+{
+    size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    out.push_back(uint8_t((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15)
+    {
+        putLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+    if (matchLength == 0)
+    {
+        return;
+    }
+    out.push_back(uint8_t(offset));
+    out.push_back(uint8_t(offset >> 8));
+    if (matchCode >= 15)
+    {
+        putLength(out, matchCode - 15);
+    }
+}
+
+static uint32_t hashBytes(const uint8_t* p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lzCompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out)
+{
+    thread_local std::vector<int64_t> table;
+    table.assign(size_t(1) << LZ_HASH_BITS, -1);
+    out.clear();
+
+    size_t literalStart = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= size)
+    {
+        uint32_t hash = hashBytes(in + i);
+        int64_t candidate = table[hash];
+        table[hash] = int64_t(i);
+        if (candidate < 0 || i - size_t(candidate) > LZ_MAX_OFFSET || std::memcmp(in + candidate, in + i, LZ_MIN_MATCH) != 0)
+        {
+            i++;
+            continue;
+        }
+        size_t length = LZ_MIN_MATCH;
+        while (i + length < size && in[candidate + length] == in[i + length])
+        {
+            length++;
+        }
+        putSequence(out, in + literalStart, i - literalStart, length, i - size_t(candidate));
+        i += length;
+        literalStart = i;
+    }
+    putSequence(out, in + literalStart, size - literalStart, 0, 0);
+}
+
+static bool getLength(const uint8_t*& p, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (p >= end)
+        {
+            return false;
+        }
+        byte = *p++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Every read and write is bounds checked, a corrupt file fails cleanly
+static bool lzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize)
+{
+    const uint8_t* p = in;
+    const uint8_t* end = in + size;
+    size_t o = 0;
+    while (p < end)
+    {
+        uint8_t token = *p++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !getLength(p, end, literalCount))
+        {
+            return false;
+        }
+        if (literalCount > size_t(end - p) || literalCount > outSize - o)
+        {
+            return false;
+        }
+        std::memcpy(out + o, p, literalCount);
+        p += literalCount;
+        o += literalCount;
+        if (p == end)
+        {
+            break;
+        }
+
+        if (end - p < 2)
+        {
+            return false;
+        }
+        size_t offset = size_t(p[0]) | (size_t(p[1]) << 8);
+        p += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(p, end, matchLength))
+        {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > o || matchLength > outSize - o)
+        {
+            return false;
+        }
+        if (offset >= matchLength)
+        {
+            std::memcpy(out + o, out + o - offset, matchLength);
+        }
+        else
+        {
+            // Overlapping, a run repeating the last offset bytes
+            for (size_t k = 0; k < matchLength; k++)
+            {
+                out[o + k] = out[o - offset + k];
+            }
+        }
+        o += matchLength;
+    }
+    return o == outSize;
+}
+
+/************************************************************************
+* Pixel encoding.
+************************************************************************/
+static int pixelBytes(FramePixel pixel)
+{
+    return pixel == FramePixel::Float16 ? sizeof(half) : sizeof(float);
+}
+
+// Rows [y0, y1) of image in the file's pixel type
+static const uint8_t* encodeRows(const Image& image, int y0, int y1, FramePixel pixel, std::vector<uint8_t>& scratch)
+{
+    const float* floats = (const float*) &image.buffer[size_t(y0) * image.width];
+    size_t count = size_t(y1 - y0) * image.width * NUM_CHANNELS;
+    if (pixel == FramePixel::Float32)
+    {
+        return (const uint8_t*) floats;
+    }
+    scratch.resize(count * sizeof(half));
+    floatsToHalves(floats, (half*) scratch.data(), int(count));
+    return scratch.data();
+}
+
+static void decodeRows(const uint8_t* in, Image& image, int y0, int y1, FramePixel pixel)
+{
+    float* floats = (float*) &image.buffer[size_t(y0) * image.width];
+    size_t count = size_t(y1 - y0) * image.width * NUM_CHANNELS;
+    if (pixel == FramePixel::Float32)
+    {
+        std::memcpy(floats, in, count * sizeof(float));
+    }
+    else
+    {
+        halvesToFloats((const half*) in, floats, int(count));
+    }
+}
+
+bool writeFrame(const char* filename, const Image& image, FramePixel pixel, FrameCompression compression)
+{
+    FrameHeader header = {};
+    std::memcpy(header.magic, FRAME_MAGIC, sizeof(header.magic));
+    header.version = FRAME_VERSION;
+    header.width = image.width;
+    header.height = image.height;
+    header.channels = NUM_CHANNELS;
+    header.layout = FrameLayout::Interleaved;
+    header.pixel = pixel;
+    header.compression = compression;
+    header.bandRows = FRAME_BAND_ROWS;
+
+    int rowBytes = image.width * NUM_CHANNELS * pixelBytes(pixel);
+    int bands = (image.height + FRAME_BAND_ROWS - 1) / FRAME_BAND_ROWS;
+    std::vector<std::vector<uint8_t>> encoded(bands);
+    std::vector<uint64_t> offsets;
+    if (compression == FrameCompression::LZ)
+    {
+        threadPool().parallelFor(bands, 1, [&](int b0, int b1)
+        {
+            thread_local std::vector<uint8_t> converted;
+            thread_local std::vector<uint8_t> shuffled;
+            for (int b = b0; b < b1; b++)
+            {
+                int y0 = b * FRAME_BAND_ROWS;
+                int y1 = std::min(image.height, y0 + FRAME_BAND_ROWS);
+                size_t bytes = size_t(y1 - y0) * rowBytes;
+                const uint8_t* rows = encodeRows(image, y0, y1, pixel, converted);
+                shuffled.resize(bytes);
+                shuffleBytes(rows, shuffled.data(), bytes / pixelBytes(pixel), pixelBytes(pixel));
+                lzCompress(shuffled.data(), bytes, encoded[b]);
+            }
+        });
+        header.pixelOffset = sizeof(FrameHeader) + (bands + 1) * sizeof(uint64_t);
+        offsets.push_back(header.pixelOffset);
+        for (const std::vector<uint8_t>& band : encoded)
+        {
+            offsets.push_back(offsets.back() + band.size());
+        }
+        header.pixelBytes = offsets.back() - header.pixelOffset;
+    }
+    else
+    {
+        header.pixelOffset = sizeof(FrameHeader);
+        header.pixelBytes = uint64_t(rowBytes) * image.height;
+    }
+
+    FILE* file = std::fopen(filename, "wb");
+    if (file == nullptr)
+    {
+        std::cerr << "ERROR: Failed to open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (compression == FrameCompression::LZ)
+    {
+        ok = ok && std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+        for (const std::vector<uint8_t>& band : encoded)
+        {
+            ok = ok && std::fwrite(band.data(), 1, band.size(), file) == band.size();
+        }
+    }
+    else if (image.pixelCount > 0)
+    {
+        std::vector<uint8_t> converted;
+        const uint8_t* rows = encodeRows(image, 0, image.height, pixel, converted);
+        ok = ok && std::fwrite(rows, 1, header.pixelBytes, file) == header.pixelBytes;
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        std::cerr << "ERROR: Failed to write " << filename << std::endl;
+    }
+    return ok;
+}
+
+/************************************************************************
+* Reading.
+************************************************************************/
+bool MappedFrame::open(const char* filename)
+{
+    if (!file.open(filename))
+    {
+        return false;
+    }
+    const FrameHeader& h = header();
+    bool valid = file.size() >= sizeof(FrameHeader)
+        && std::memcmp(h.magic, FRAME_MAGIC, sizeof(h.magic)) == 0
+        && h.version == FRAME_VERSION
+        && h.width >= 0 && h.height >= 0
+        && h.channels == NUM_CHANNELS
+        && h.layout == FrameLayout::Interleaved
+        && (h.pixel == FramePixel::Float32 || h.pixel == FramePixel::Float16)
+        && (h.compression == FrameCompression::None || h.compression == FrameCompression::LZ)
+        && h.bandRows > 0
+        && h.pixelOffset <= file.size()
+        && h.pixelBytes <= file.size() - h.pixelOffset
+        // Image sizes its buffer with int math
+        && uint64_t(h.width) * h.height <= uint64_t(INT_MAX / NUM_CHANNELS);
+    uint64_t decodedBytes = valid ? uint64_t(h.width) * h.height * NUM_CHANNELS * pixelBytes(h.pixel) : 0;
+    if (valid && h.compression == FrameCompression::None)
+    {
+        valid = h.pixelBytes == decodedBytes;
+    }
+    if (valid && h.compression == FrameCompression::LZ)
+    {
+        // A header can't claim more pixels than its bands could decode to
+        uint64_t bands = (uint64_t(h.height) + h.bandRows - 1) / h.bandRows;
+        valid = h.pixelOffset >= sizeof(FrameHeader) + (bands + 1) * sizeof(uint64_t)
+            && decodedBytes <= h.pixelBytes * LZ_MAX_EXPANSION;
+    }
+    if (!valid)
+    {
+        file.close();
+    }
+    return valid;
+}
+
+bool MappedFrame::direct() const
+{
+    return header().pixel == FramePixel::Float32
+        && header().compression == FrameCompression::None
+        && header().pixelOffset % alignof(col4f) == 0;
+}
+
+ConstImageView MappedFrame::view() const
+{
+    return { (const col4f*) (file.data() + header().pixelOffset), header().width, 0, 0 };
+}
+
+bool MappedFrame::read(Image& image) const
+{
+    const FrameHeader& h = header();
+    image.resize(h.width, h.height);
+    const uint8_t* pixels = file.data() + h.pixelOffset;
+    size_t rowBytes = size_t(h.width) * NUM_CHANNELS * pixelBytes(h.pixel);
+    if (h.compression == FrameCompression::None)
+    {
+        threadPool().parallelFor(h.height, 1, [&](int y0, int y1)
+        {
+            decodeRows(pixels + y0 * rowBytes, image, y0, y1, h.pixel);
+        });
+        return true;
+    }
+
+    const uint64_t* offsets = (const uint64_t*) (file.data() + sizeof(FrameHeader));
+    int bands = int((int64_t(h.height) + h.bandRows - 1) / h.bandRows);
+    std::atomic<bool> failed(false);
+    threadPool().parallelFor(bands, 1, [&](int b0, int b1)
+    {
+        thread_local std::vector<uint8_t> shuffled;
+        thread_local std::vector<uint8_t> rows;
+        for (int b = b0; b < b1; b++)
+        {
+            int y0 = b * h.bandRows;
+            int y1 = int(std::min<int64_t>(h.height, int64_t(y0) + h.bandRows));
+            size_t bytes = size_t(y1 - y0) * rowBytes;
+            uint64_t begin = offsets[b];
+            uint64_t end = offsets[b + 1];
+            if (begin > end || begin < h.pixelOffset || end > file.size())
+            {
+                failed = true;
+                continue;
+            }
+            shuffled.resize(bytes);
+            rows.resize(bytes);
+            if (!lzDecompress(file.data() + begin, end - begin, shuffled.data(), bytes))
+            {
+                failed = true;
+                continue;
+            }
+            unshuffleBytes(shuffled.data(), rows.data(), bytes / pixelBytes(h.pixel), pixelBytes(h.pixel));
+            decodeRows(rows.data(), image, y0, y1, h.pixel);
+        }
+    });
+    return !failed;
+}
+
+bool readFrame(const char* filename, Image& image)
+{
+    MappedFrame frame;
+    if (!frame.open(filename))
+    {
+        std::cerr << "ERROR: Failed to load frame " << filename << std::endl;
+        return false;
+    }
+    if (!frame.read(image))
+    {
+        std::cerr << "ERROR: Corrupt frame data in " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool isFrameFile(const char* filename)
+{
+    std::string name(filename);
+    return name.size() >= 4 && name.compare(name.size() - 4, 4, ".cfr") == 0;
+}
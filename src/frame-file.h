@@ -0,0 +1,120 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: frame-file.h
+ *
+ * Native frame format for intermediates, ".cfr". A 64 byte header
+ * followed by RGBA pixels, interleaved like Image, as 32-bit or 16-bit
+ * floats. Pixels are either stored raw, so a mapped file can be read in
+ * place, or split into bands of rows that are each byte-shuffled and
+ * LZ compressed on their own, so bands encode and decode in parallel.
+ * No 8-bit quantization and no deflate, unlike a PNG round trip.
+************************************************************************/
+
+#ifndef FRAME_FILE_H
+#define FRAME_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "image.h"
+
+const char FRAME_MAGIC[4] = { 'C', 'F', 'R', 'M' };
+const uint32_t FRAME_VERSION = 1;
+// Rows per independently compressed band
+const int FRAME_BAND_ROWS = 32;
+
+enum class FramePixel : uint8_t
+{
+    Float32,
+    Float16
+};
+
+enum class FrameCompression : uint8_t
+{
+    None,
+    LZ // Byte-shuffled, then LZ4-style literal/match runs
+};
+
+enum class FrameLayout : uint8_t
+{
+    Interleaved // RGBARGBA..., rows top to bottom
+};
+
+struct FrameHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint8_t channels;
+    FrameLayout layout;
+    FramePixel pixel;
+    FrameCompression compression;
+    int32_t bandRows;
+    // From the start of the file. Compressed frames have a table of
+    // band offsets, one per band plus the end, between header and pixels.
+    uint64_t pixelOffset;
+    uint64_t pixelBytes;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(FrameHeader) == 64, "FrameHeader is stored as is");
+
+// View of a whole file, mmap or MapViewOfFile. Writes to a created
+// mapping go back to the file, the OS pages it in and out as needed.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* filename); // Read-only
+    bool create(const char* filename, size_t size); // Read-write, zero filled
+    void close();
+
+    const uint8_t* data() const { return bytes; }
+    uint8_t* writableData() const { return writable ? bytes : nullptr; }
+    size_t size() const { return length; }
+
+private:
+    uint8_t* bytes = nullptr;
+    size_t length = 0;
+    bool writable = false;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+
+    bool map(const char* filename, size_t size, bool write);
+};
+
+/************************************************************************
+* A mapped .cfr file. Raw 32-bit frames can be viewed where they sit in
+* the mapping with no copy at all, anything else is decoded by read().
+************************************************************************/
+class MappedFrame
+{
+public:
+    bool open(const char* filename);
+    void close() { file.close(); }
+
+    const FrameHeader& header() const { return *(const FrameHeader*) file.data(); }
+    // True when view() can point straight into the file
+    bool direct() const;
+    // Only valid while open and direct()
+    ConstImageView view() const;
+    // Decode or copy the pixels into image, false if the data is corrupt
+    bool read(Image& image) const;
+
+private:
+    MappedFile file;
+};
+
+bool writeFrame(const char* filename, const Image& image, FramePixel pixel = FramePixel::Float32, FrameCompression compression = FrameCompression::None);
+bool readFrame(const char* filename, Image& image);
+// Whether filename ends in .cfr, Image::read and write dispatch on it
+bool isFrameFile(const char* filename);
+
+#endif
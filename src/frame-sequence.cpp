@@ -0,0 +1,132 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: frame-sequence.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "frame-sequence.h"
+#include "frame-source.h"
+#include "thread-pool.h"
+
+static uint64_t frameBytes(int width, int height)
+{
+    return uint64_t(width) * height * sizeof(col4f);
+}
+
+static uint64_t alignUp(uint64_t value)
+{
+    return (value + SEQUENCE_ALIGNMENT - 1) / SEQUENCE_ALIGNMENT * SEQUENCE_ALIGNMENT;
+}
+
+bool FrameSequence::open(const char* filename)
+{
+    if (!file.open(filename))
+    {
+        return false;
+    }
+    const SequenceHeader& h = header();
+    bool valid = file.size() >= sizeof(SequenceHeader)
+        && std::memcmp(h.magic, SEQUENCE_MAGIC, sizeof(h.magic)) == 0
+        && h.version == SEQUENCE_VERSION
+        && h.width >= 0 && h.height >= 0 && h.frames >= 0
+        && h.channels == NUM_CHANNELS
+        && h.layout == FrameLayout::Interleaved
+        && h.pixel == FramePixel::Float32
+        && h.frameOffset % alignof(col4f) == 0
+        && h.frameStride % alignof(col4f) == 0
+        && h.frameStride >= frameBytes(h.width, h.height)
+        && h.frameOffset + h.frameStride * uint64_t(h.frames) <= file.size();
+    if (!valid)
+    {
+        file.close();
+    }
+    return valid;
+}
+
+bool FrameSequence::create(const char* filename, int frames, int width, int height)
+{
+    SequenceHeader h = {};
+    std::memcpy(h.magic, SEQUENCE_MAGIC, sizeof(h.magic));
+    h.version = SEQUENCE_VERSION;
+    h.width = width;
+    h.height = height;
+    h.frames = frames;
+    h.channels = NUM_CHANNELS;
+    h.layout = FrameLayout::Interleaved;
+    h.pixel = FramePixel::Float32;
+    h.frameOffset = alignUp(sizeof(SequenceHeader));
+    h.frameStride = alignUp(frameBytes(width, height));
+
+    // A new file's pages read as zero until written, so this doesn't
+    // touch the frames
+    if (!file.create(filename, h.frameOffset + h.frameStride * uint64_t(frames)))
+    {
+        std::cerr << "ERROR: Failed to create sequence " << filename << std::endl;
+        return false;
+    }
+    std::memcpy(file.writableData(), &h, sizeof(h));
+    return true;
+}
+
+ConstImageView FrameSequence::frame(int i) const
+{
+    const uint8_t* data = file.data() + header().frameOffset + header().frameStride * uint64_t(i);
+    return { (const col4f*) data, header().width, 0, 0 };
+}
+
+ImageView FrameSequence::writableFrame(int i)
+{
+    uint8_t* data = file.writableData() + header().frameOffset + header().frameStride * uint64_t(i);
+    return { (col4f*) data, header().width, 0, 0 };
+}
+
+// Removes the partial container, nothing half built is left to open
+static bool abandonSequence(FrameSequence& sequence, const char* filename)
+{
+    sequence.close();
+    std::remove(filename);
+    return false;
+}
+
+bool buildSequence(const char* filename, std::string stem, std::string extension, int first, int count)
+{
+    if (count <= 0)
+    {
+        return false;
+    }
+    FrameSource frames(stem, extension, first, first + count - 1, 4, 2);
+    FrameSequence sequence;
+    Image image;
+    int frame;
+    int packed = 0;
+    while (frames.next(image, frame))
+    {
+        // The first frame sets the size of every frame
+        if (packed == 0 && !sequence.create(filename, count, image.width, image.height))
+        {
+            return abandonSequence(sequence, filename);
+        }
+        if (image.width != sequence.width() || image.height != sequence.height())
+        {
+            std::cerr << "ERROR: " << fileName(stem, frame, extension) << " doesn't match the sequence size" << std::endl;
+            return abandonSequence(sequence, filename);
+        }
+        ImageView out = sequence.writableFrame(frame - first);
+        threadPool().parallelFor(image.height, 1, [&](int y0, int y1)
+        {
+            std::copy(&image(0, y0), &image(0, y0) + size_t(y1 - y0) * image.width, out.at(0, y0));
+        });
+        packed++;
+    }
+    if (frames.failed() || packed != count)
+    {
+        std::cerr << "ERROR: Packed " << packed << " of " << count << " frames into " << filename << std::endl;
+        // Nothing was created if the first frame never decoded
+        return packed > 0 ? abandonSequence(sequence, filename) : false;
+    }
+    return true;
+}
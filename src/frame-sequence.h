@@ -0,0 +1,73 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: frame-sequence.h
+ *
+ * Single-file container for a whole image sequence, ".cfs". A 64 byte
+ * header, then every frame as raw float32 RGBA at a fixed stride, each
+ * starting on a page boundary. The file is memory mapped, so a frame is
+ * just a view into the mapping. Only the pages actually read are
+ * resident and the OS pages them out again under pressure, so sequences
+ * larger than RAM work.
+************************************************************************/
+
+#ifndef FRAME_SEQUENCE_H
+#define FRAME_SEQUENCE_H
+
+#include <cstdint>
+#include <string>
+
+#include "frame-file.h"
+#include "image.h"
+
+const char SEQUENCE_MAGIC[4] = { 'C', 'F', 'S', 'Q' };
+const uint32_t SEQUENCE_VERSION = 1;
+// Frames start on multiples of this, a page on every platform we target
+const uint64_t SEQUENCE_ALIGNMENT = 4096;
+
+struct SequenceHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t frames;
+    uint8_t channels;
+    FrameLayout layout;
+    FramePixel pixel; // Always Float32 for now, frames are viewed in place
+    uint8_t padding;
+    uint64_t frameOffset; // From the start of the file to frame 0
+    uint64_t frameStride; // Bytes from one frame to the next
+    uint8_t reserved[24];
+};
+static_assert(sizeof(SequenceHeader) == 64, "SequenceHeader is stored as is");
+
+class FrameSequence
+{
+public:
+    // Map an existing container read-only
+    bool open(const char* filename);
+    // Make a new container of black frames, mapped read-write
+    bool create(const char* filename, int frames, int width, int height);
+    void close() { file.close(); }
+
+    int size() const { return header().frames; }
+    int width() const { return header().width; }
+    int height() const { return header().height; }
+
+    // Frame i, 0 based, valid while the sequence is open
+    ConstImageView frame(int i) const;
+    // Only for a sequence made by create()
+    ImageView writableFrame(int i);
+
+private:
+    MappedFile file;
+
+    const SequenceHeader& header() const { return *(const SequenceHeader*) file.data(); }
+};
+
+// Decode fileName(stem, first..first + count - 1, extension) into a new
+// container at filename, reading ahead on background threads. On failure
+// the file is removed
+bool buildSequence(const char* filename, std::string stem, std::string extension, int first, int count);
+
+#endif
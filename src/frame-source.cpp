@@ -0,0 +1,140 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: frame-source.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "frame-source.h"
+
+FrameSource::FrameSource(std::string stem, std::string extension, int first, int last, int depth, int decoders)
+    : stem(stem), extension(extension), first(first), last(last),
+      slots(std::max(1, depth)), nextDecode(first), nextConsume(first)
+{
+    totals.minDepth = int(slots.size());
+    for (int i = 0; i < std::max(1, decoders); i++)
+    {
+        this->decoders.emplace_back(&FrameSource::decodeLoop, this);
+    }
+}
+
+FrameSource::~FrameSource()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    consumed.notify_all();
+    for (std::thread& decoder : decoders)
+    {
+        decoder.join();
+    }
+}
+
+/************************************************************************
+* Frame f lives in slot (f - first) % depth. A decoder claims the next
+* frame, waits for its slot to be handed back if the ring is full, then
+* decodes outside the lock. With several decoders frames can finish out
+* of order, each still lands in its own slot.
+************************************************************************/
+void FrameSource::decodeLoop()
+{
+    using clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        if (stopping || nextDecode > last)
+        {
+            return;
+        }
+        int frame = nextDecode++;
+        Slot& slot = slots[(frame - first) % slots.size()];
+        consumed.wait(lock, [&] { return stopping || frame < nextConsume + int(slots.size()); });
+        if (stopping)
+        {
+            return;
+        }
+
+        lock.unlock();
+        auto start = clock::now();
+        bool loaded = slot.image.read(fileName(stem, frame, extension).c_str());
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        lock.lock();
+
+        totals.decodeMs += ms;
+        slot.failed = !loaded;
+        slot.ready = true;
+        decoded.notify_all();
+    }
+}
+
+bool FrameSource::next(Image& image, int& frame)
+{
+    using clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (nextConsume > last)
+    {
+        return false;
+    }
+    Slot& slot = slots[(nextConsume - first) % slots.size()];
+
+    // Frames decoded and waiting, not counting any still in flight
+    int depth = 0;
+    for (int f = nextConsume; f <= last && f < nextConsume + int(slots.size()); f++)
+    {
+        depth += slots[(f - first) % slots.size()].ready ? 1 : 0;
+    }
+    totals.minDepth = std::min(totals.minDepth, depth);
+    depthSum += depth;
+
+    if (!slot.ready)
+    {
+        auto start = clock::now();
+        decoded.wait(lock, [&] { return slot.ready; });
+        totals.stalls++;
+        totals.stallMs += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    if (slot.failed)
+    {
+        // Stop rather than hand out the stale pixels left in the slot
+        frame = nextConsume;
+        nextConsume = last + 1;
+        failure = true;
+        stopping = true;
+        consumed.notify_all();
+        return false;
+    }
+
+    std::swap(image, slot.image);
+    slot.ready = false;
+    frame = nextConsume++;
+    totals.frames++;
+    consumed.notify_all();
+    return true;
+}
+
+bool FrameSource::failed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure;
+}
+
+FrameSourceStats FrameSource::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    FrameSourceStats result = totals;
+    result.averageDepth = totals.frames > 0 ? double(depthSum) / totals.frames : 0.0;
+    return result;
+}
+
+void FrameSource::printStats() const
+{
+    FrameSourceStats result = stats();
+    std::cout << "Frames Loaded: " << result.frames << std::endl;
+    std::cout << "Total Decode Time: " << result.decodeMs << "ms" << std::endl;
+    std::cout << "Stalls: " << result.stalls << ", " << result.stallMs << "ms" << std::endl;
+    std::cout << "Queue Depth: " << result.averageDepth << " average, " << result.minDepth << " min of " << slots.size() << std::endl;
+}
@@ -0,0 +1,85 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: frame-source.h
+ *
+ * Read-ahead loader for numbered image sequences. Background threads
+ * decode the frames after the one being composited into a small ring of
+ * slots, so by the time the compute stage asks for a frame it's usually
+ * already sitting in memory. The ring's size bounds how far ahead the
+ * decoders run and how many frames are held at once.
+************************************************************************/
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image.h"
+
+struct FrameSourceStats
+{
+    int frames = 0;          // Frames handed out by next()
+    int stalls = 0;          // Times next() had to wait on a decode
+    double stallMs = 0.0;    // Total time next() spent waiting
+    double decodeMs = 0.0;   // Total decode time across the threads
+    int minDepth = 0;        // Fewest decoded frames queued at a next()
+    double averageDepth = 0.0;
+};
+
+class FrameSource
+{
+public:
+    // Frames first through last inclusive of fileName(stem, frame, extension).
+    // depth frames are decoded ahead on decoders background threads.
+    FrameSource(std::string stem, std::string extension, int first, int last, int depth = 4, int decoders = 1);
+    ~FrameSource();
+
+    FrameSource(const FrameSource&) = delete;
+    FrameSource& operator=(const FrameSource&) = delete;
+
+    /*
+     * Wait for the next frame in order and swap it into image, returning
+     * false once the sequence is done. image's old buffer goes back into
+     * the ring for the decoders to reuse. A frame that fails to decode
+     * ends the sequence there, with frame set to it and failed() true.
+     */
+    bool next(Image& image, int& frame);
+    bool failed() const;
+
+    FrameSourceStats stats() const;
+    void printStats() const;
+
+private:
+    struct Slot
+    {
+        Image image;
+        bool ready = false;
+        bool failed = false; // image holds whatever the slot last held
+    };
+
+    std::string stem;
+    std::string extension;
+    int first;
+    int last;
+    std::vector<Slot> slots;
+    std::vector<std::thread> decoders;
+
+    mutable std::mutex mutex;
+    std::condition_variable decoded;  // A slot became ready
+    std::condition_variable consumed; // A slot was freed
+    int nextDecode;  // Next frame a decoder claims
+    int nextConsume; // Next frame next() hands out
+    bool stopping = false;
+    bool failure = false;
+
+    FrameSourceStats totals;
+    long long depthSum = 0;
+
+    void decodeLoop();
+};
+
+#endif
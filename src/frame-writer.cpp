@@ -0,0 +1,121 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: frame-writer.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "frame-writer.h"
+
+FrameWriter::FrameWriter(int encoders, int depth)
+{
+    if (encoders <= 0)
+    {
+        encoders = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->depth = depth > 0 ? depth : 2 * encoders;
+    for (int i = 0; i < encoders; i++)
+    {
+        this->encoders.emplace_back(&FrameWriter::encodeLoop, this);
+    }
+}
+
+FrameWriter::~FrameWriter()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (std::thread& encoder : encoders)
+    {
+        encoder.join();
+    }
+}
+
+void FrameWriter::encodeLoop()
+{
+    using clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        queued.wait(lock, [&] { return !queue.empty() || stopping; });
+        if (queue.empty())
+        {
+            return;
+        }
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        encoding++;
+
+        lock.unlock();
+        auto start = clock::now();
+        job.image.write(job.filename.c_str());
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        lock.lock();
+
+        totals.frames++;
+        totals.encodeMs += ms;
+        encoding--;
+        spares.push_back(std::move(job.image));
+        done.notify_all();
+    }
+}
+
+/************************************************************************
+* Jobs queued or being encoded count against depth, so at most depth
+* frames plus the callers' own are alive. The caller gets a spare back,
+* resized to match; a spare the same size as the frame keeps its
+* allocation, so a fixed-size sequence stops allocating once the queue
+* has filled the first time.
+************************************************************************/
+void FrameWriter::write(Image& image, std::string filename)
+{
+    using clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (int(queue.size()) + encoding >= depth)
+    {
+        auto start = clock::now();
+        done.wait(lock, [&] { return int(queue.size()) + encoding < depth; });
+        totals.blocks++;
+        totals.blockedMs += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    Image spare;
+    if (!spares.empty())
+    {
+        spare = std::move(spares.back());
+        spares.pop_back();
+    }
+    int width = image.width;
+    int height = image.height;
+    queue.push_back({ std::move(image), filename });
+    queued.notify_one();
+    lock.unlock();
+
+    image = std::move(spare);
+    image.resize(width, height);
+}
+
+void FrameWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return queue.empty() && encoding == 0; });
+}
+
+FrameWriterStats FrameWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
+
+void FrameWriter::printStats() const
+{
+    FrameWriterStats result = stats();
+    std::cout << "Frames Written: " << result.frames << " on " << encoders.size() << " encoders" << std::endl;
+    std::cout << "Total Encode Time: " << result.encodeMs << "ms" << std::endl;
+    std::cout << "Backpressure: " << result.blocks << ", " << result.blockedMs << "ms" << std::endl;
+}
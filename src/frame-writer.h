@@ -0,0 +1,78 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: frame-writer.h
+ *
+ * Write-behind encoder pool. write() takes a finished frame off the
+ * caller by swapping buffers with a spare and returns right away, while
+ * background threads convert and PNG-encode the queued frames in
+ * parallel. Once the queue is full, write() blocks until an encoder
+ * frees a slot, so rendering can't run unboundedly ahead of the disk.
+************************************************************************/
+
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image.h"
+
+struct FrameWriterStats
+{
+    int frames = 0;          // Frames encoded
+    double encodeMs = 0.0;   // Total encode time across the threads
+    int blocks = 0;          // Times write() waited on a full queue
+    double blockedMs = 0.0;  // Total time write() spent waiting
+};
+
+class FrameWriter
+{
+public:
+    // 0 encoders picks the hardware thread count, 0 depth twice that
+    explicit FrameWriter(int encoders = 0, int depth = 0);
+    // Finishes everything still queued
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    /*
+     * Queue image to be written to filename. image hands its pixels over
+     * and comes back holding a recycled buffer of the same size, with
+     * unspecified contents. Safe to call from several threads.
+     */
+    void write(Image& image, std::string filename);
+    // Wait until every queued frame is on disk
+    void flush();
+
+    FrameWriterStats stats() const;
+    void printStats() const;
+
+private:
+    struct Job
+    {
+        Image image;
+        std::string filename;
+    };
+
+    int depth;
+    std::deque<Job> queue;
+    std::vector<Image> spares; // Buffers of written frames, for reuse
+    std::vector<std::thread> encoders;
+    int encoding = 0; // Jobs taken off the queue but not yet written
+
+    mutable std::mutex mutex;
+    std::condition_variable queued; // A job was added, or stopping
+    std::condition_variable done;   // A job finished
+    bool stopping = false;
+
+    FrameWriterStats totals;
+
+    void encodeLoop();
+};
+
+#endif
@@ -0,0 +1,146 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: half-float.cpp
+ *
+ *******************************************/
+
+#include <immintrin.h>
+#include <cstring>
+#include "half-float.h"
+
+half floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    // Inf and NaN, keeping NaNs quiet and non-zero
+    if (exponent == 0xFF)
+    {
+        return half(sign | 0x7C00 | (mantissa ? 0x200 | (mantissa >> 13) : 0));
+    }
+    int halfExponent = int(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+    {
+        return half(sign | 0x7C00);
+    }
+    if (halfExponent <= 0)
+    {
+        // Subnormal or zero, shift the implicit 1 in and round
+        if (halfExponent < -10)
+        {
+            return half(sign);
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - halfExponent;
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+        {
+            result++;
+        }
+        return half(sign | result);
+    }
+    // Normal, a carry out of the mantissa rolls into the exponent
+    uint32_t result = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+    {
+        result++;
+    }
+    return half(sign | result);
+}
+
+float halfToFloat(half value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0)
+    {
+        bits = sign;
+    }
+    else
+    {
+        // Subnormal, normalize it
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+bool cpuHasF16C()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool hasF16C = __builtin_cpu_supports("f16c");
+    return hasF16C;
+#else
+    return false;
+#endif
+}
+
+/************************************************************************
+* F16C conversions, eight values at a time. Compiled for F16C regardless
+* of the global flags, only ever called after cpuHasF16C(). They return
+* how many values they converted, the rest go through the scalar code.
+************************************************************************/
+#define F16C __attribute__((target("f16c,avx")))
+
+F16C static int f16cFloatsToHalves(const float* in, half* out, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(out + i), halves);
+    }
+    return i;
+}
+
+F16C static int f16cHalvesToFloats(const half* in, float* out, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i halves = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(halves));
+    }
+    return i;
+}
+
+void floatsToHalves(const float* in, half* out, int count)
+{
+    int i = cpuHasF16C() ? f16cFloatsToHalves(in, out, count) : 0;
+    for (; i < count; i++)
+    {
+        out[i] = floatToHalf(in[i]);
+    }
+}
+
+void halvesToFloats(const half* in, float* out, int count)
+{
+    int i = cpuHasF16C() ? f16cHalvesToFloats(in, out, count) : 0;
+    for (; i < count; i++)
+    {
+        out[i] = halfToFloat(in[i]);
+    }
+}
@@ -0,0 +1,34 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: half-float.h
+ *
+ * IEEE 754 binary16 conversion for storing pixels at half the size.
+ * The span conversions use F16C, 8 values per instruction, when the
+ * CPU has it, with a bit-exact scalar fallback. Rounding is to nearest
+ * even both ways.
+************************************************************************/
+
+#ifndef HALF_FLOAT_H
+#define HALF_FLOAT_H
+
+#include <cstdint>
+
+using half = uint16_t;
+
+// col4f at half the size, for storage only, math happens on col4f
+struct col4h
+{
+    half r;
+    half g;
+    half b;
+    half a;
+};
+
+half floatToHalf(float value);
+float halfToFloat(half value);
+
+bool cpuHasF16C();
+void floatsToHalves(const float* in, half* out, int count);
+void halvesToFloats(const half* in, float* out, int count);
+
+#endif
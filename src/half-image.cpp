@@ -0,0 +1,65 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: half-image.cpp
+ *
+ *******************************************/
+
+#include "half-image.h"
+#include "image.h"
+#include "thread-pool.h"
+
+// Fewest pixels per thread pool chunk for the conversions
+static const int HALF_GRAIN = 16 * 1024;
+
+HalfImage::HalfImage()
+{
+    this->width = 0;
+    this->height = 0;
+    this->aspectRatio = 1.0f;
+    this->pixelCount = 0;
+}
+
+HalfImage::HalfImage(int width, int height)
+{
+    this->resize(width, height);
+}
+
+void HalfImage::resize(int width, int height)
+{
+    if (width >= 0 && height >= 0)
+    {
+        this->width = width;
+        this->height = height;
+        this->aspectRatio = float(width) / float(height);
+        this->pixelCount = width * height;
+        buffer.resize(pixelCount);
+    }
+}
+
+void widenPixels(const col4h* in, col4f* out, int count)
+{
+    halvesToFloats(&in->r, &out->r, NUM_CHANNELS * count);
+}
+
+void narrowPixels(const col4f* in, col4h* out, int count)
+{
+    floatsToHalves(&in->r, &out->r, NUM_CHANNELS * count);
+}
+
+void HalfImage::read(const Image& image)
+{
+    resize(image.width, image.height);
+    threadPool().parallelFor(pixelCount, HALF_GRAIN, [&](int begin, int end)
+    {
+        narrowPixels(image.buffer.data() + begin, buffer.data() + begin, end - begin);
+    });
+}
+
+void HalfImage::write(Image& image) const
+{
+    image.resize(width, height);
+    threadPool().parallelFor(pixelCount, HALF_GRAIN, [&](int begin, int end)
+    {
+        widenPixels(buffer.data() + begin, image.buffer.data() + begin, end - begin);
+    });
+}
@@ -0,0 +1,52 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: half-image.h
+ *
+ * Image stored as IEEE half floats, 8 bytes a pixel instead of 16.
+ * Still HDR, halves go up to 65504, so values past 1 from bloom and
+ * brightness survive. Ops load a block of pixels, widen it to col4f
+ * with F16C, do their math in float and narrow on the way out.
+************************************************************************/
+
+#ifndef HALF_IMAGE_H
+#define HALF_IMAGE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "color.h"
+#include "half-float.h"
+
+class Image;
+
+class HalfImage
+{
+public:
+    std::vector<col4h> buffer;
+    int width;
+    int height;
+    float aspectRatio;
+
+    int pixelCount; // Current image size
+
+    HalfImage();
+    HalfImage(int width, int height);
+    void resize(int width, int height);
+
+    // Conversion points, rounding to nearest even on the way down
+    void read(const Image& image); // float -> half
+    void write(Image& image) const; // half -> float
+
+    inline col4h& operator()(size_t x, size_t y) noexcept {
+        return buffer[y * width + x];
+    }
+    inline const col4h& operator()(size_t x, size_t y) const noexcept {
+        return buffer[y * width + x];
+    }
+};
+
+// count pixels between col4f and col4h
+void widenPixels(const col4h* in, col4f* out, int count);
+void narrowPixels(const col4f* in, col4h* out, int count);
+
+#endif
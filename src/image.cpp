@@ -11,13 +11,57 @@
 #include <numbers>
 #include <vector>
 #include <new>
-#include <iomanip>
 #include "image.h"
+#include "frame-file.h"
 #include "matrix.h"
 #include "math.h"
 #include "perlin-noise.h"
+#include "pixel-kernels.h"
+#include "thread-pool.h"
 #include <cmath>
 
+// Default Tikhonov lambda for gaussianDeBlur
+static const float DEBLUR_REGULARIZATION = 1e-3f;
+
+// Smallest chunk the per-pixel ops hand to the thread pool, big enough
+// that handing it out costs little next to running it
+static const int PIXEL_GRAIN = 16 * 1024;
+// Narrowest column span the column-wise passes hand out, 4 cache lines
+static const int COLUMN_GRAIN = 16;
+
+// Scratch rows for whichever thread runs a chunk, so parallel passes
+// don't share a buffer
+static std::vector<col4f>& threadRow(int slot, int width)
+{
+    thread_local std::vector<col4f> rows[2];
+    rows[slot].resize(width);
+    return rows[slot];
+}
+
+// Run span(begin, end) over [0, count) pixels on the thread pool
+template <typename F>
+static void parallelPixels(int count, F&& span)
+{
+    threadPool().parallelFor(count, PIXEL_GRAIN, span);
+}
+
+// Run band(y0, y1) over bands of rows [0, height) on the thread pool
+template <typename F>
+static void parallelRows(int height, F&& band)
+{
+    threadPool().parallelFor(height, 1, band);
+}
+
+// Run span(f0, f1) over float columns of rows width pixels wide
+template <typename F>
+static void parallelColumns(int width, F&& span)
+{
+    threadPool().parallelFor(width, COLUMN_GRAIN, [&](int x0, int x1)
+    {
+        span(NUM_CHANNELS * x0, NUM_CHANNELS * x1);
+    });
+}
+
 std::string fileName(std::string stem, int frame, std::string extension)
 {
     std::string suffix = "";
@@ -57,8 +101,12 @@ void Image::resize(int width, int height)
 }
 
 // From file bufferer
-void Image::read(const char *filename)
+bool Image::read(const char *filename)
 {
+    if (isFrameFile(filename))
+    {
+        return readFrame(filename, *this);
+    }
     int newWidth;
     int newHeight;
     int nrChannels;
@@ -76,10 +124,12 @@ void Image::read(const char *filename)
             buffer[i] = colItoF(intBuffer[i]);
         }
         stbi_image_free(data);
+        return true;
     }
     else
     {
         std::cerr << "ERROR: STBI Failed to load the image" << std::endl;
+        return false;
     }
 }
 
@@ -92,23 +142,26 @@ void Image::read(const Image& image)
     }
 }
 
-// TODO: Handle intBuffer allocation failure
-void Image::write(const char *filename)
+// The 8-bit conversion buffer is kept per thread, so encoder threads
+// writing frame after frame don't reallocate it each time
+bool Image::write(const char *filename) const
 {
-    col4i *intBuffer = new col4i[pixelCount];
-    if (intBuffer != nullptr)
+    if (isFrameFile(filename))
     {
-        for (int i = 0; i < pixelCount; i++)
-        {
-            intBuffer[i] = colFtoI(buffer[i]);
-        }
-        stbi_write_png(filename, this->width, this->height, NUM_CHANNELS, intBuffer, this->width * sizeof(uint8_t) * NUM_CHANNELS);
-        delete[] intBuffer;
+        return writeFrame(filename, *this);
     }
-    else
+    thread_local std::vector<col4i> intBuffer;
+    intBuffer.resize(pixelCount);
+    for (int i = 0; i < pixelCount; i++)
+    {
+        intBuffer[i] = colFtoI(buffer[i]);
+    }
+    if (!stbi_write_png(filename, this->width, this->height, NUM_CHANNELS, intBuffer.data(), this->width * sizeof(uint8_t) * NUM_CHANNELS))
     {
-        std::cerr << "ERROR: Intbuffer allocation failed while writing to file." << std::endl;
+        std::cerr << "ERROR: STBI Failed to write the image" << std::endl;
+        return false;
     }
+    return true;
 }
 
 col4f Image::nearestNeighbor(float tx, float ty)
@@ -220,10 +273,13 @@ col4f ImagePipeline::min(const Image& image)
 void ImagePipeline::toNegative(const Image& input, Image& output)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        output[i] = negative(input[i]);
-    }
+        kernels.negative(in + begin, out + begin, end - begin);
+    });
 }
 
 
@@ -239,243 +295,712 @@ void ImagePipeline::scaleContrast(const Image& input, Image& output, float contr
     float max = std::max(std::max(maxPixel.r, maxPixel.g), maxPixel.b);
     float delta = max - min;
     
-    for (int i = 0; i < input.pixelCount; i++)
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        output[i].r = (((input[i].r - min) / delta) * deltaOut) + lowerBound;
-        output[i].g = (((input[i].g - min) / delta) * deltaOut) + lowerBound;
-        output[i].b = (((input[i].b - min) / delta) * deltaOut) + lowerBound;
-        output[i].a = input[i].a;
-    }
+        for (int i = begin; i < end; i++)
+        {
+            output[i].r = (((input[i].r - min) / delta) * deltaOut) + lowerBound;
+            output[i].g = (((input[i].g - min) / delta) * deltaOut) + lowerBound;
+            output[i].b = (((input[i].b - min) / delta) * deltaOut) + lowerBound;
+            output[i].a = input[i].a;
+        }
+    });
 }
 
 void ImagePipeline::scaleBrightness(const Image& input, Image& output, float scale)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        output[i] = scale * input[i];
-    }
+        kernels.scaleBrightness(in + begin, out + begin, end - begin, scale);
+    });
 }
 
 void ImagePipeline::toGreyscale(const Image& input, Image& output, col4f weights)
 {
     output.resize(input.width, input.height);
-    float avg;
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        avg = brightness(input[i] * weights);
-        output[i] = col4f(avg, avg, avg, input[i].a);
-    }
+        kernels.toGreyscale(in + begin, out + begin, end - begin, weights);
+    });
 }
 
 void ImagePipeline::threshold(const Image& input, Image& output, float threshold)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        float avg = (input[i].r + input[i].g + input[i].b) / 3.0f;
-        if (avg > threshold)
-        {
-            output[i] = col4f(1.0f, 1.0f, 1.0f, 1.0f);
-        }
-        else
-        {
-            output[i] = col4f(0.0f, 0.0f, 0.0f, 0.0f);
-        }
-    }
+        kernels.threshold(in + begin, out + begin, end - begin, threshold);
+    });
 }
 
 void ImagePipeline::thresholdColor(const Image& input, Image& output, float thresh)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        float avg = (input[i].r + input[i].g + input[i].b) / 3.0f;
-        if (avg > thresh)
-        {
-            output[i] = input[i];
-        }
-        else
-        {
-            output[i] = col4f(0.0f, 0.0f, 0.0f, 0.0f);
-        }
-    }
+        kernels.thresholdColor(in + begin, out + begin, end - begin, thresh);
+    });
 }
 
 void ImagePipeline::colorTint(const Image& input, Image& output, col4f tint)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        output[i] = blendOver(tint, input[i]);
-    }
+        kernels.colorTint(in + begin, out + begin, end - begin, tint);
+    });
 }
 
 void ImagePipeline::adjustHSV(const Image& input, Image& output, col4f_hsv_t hsv)
 {
     output.resize(input.width, input.height);
-    for (int i = 0; i < input.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    parallelPixels(input.pixelCount, [&](int begin, int end)
     {
-        col4f_hsv_t pixel = colRGBAtoHSVA(input[i]);
-        pixel.h = pixel.h + hsv.h;
-        pixel.s = pixel.s * hsv.s;
-        pixel.v = pixel.v * hsv.v;
-        output[i] = colHSVAtoRGBA(pixel);
-    }
+        kernels.adjustHSV(in + begin, out + begin, end - begin, hsv);
+    });
 }
 
-void ImagePipeline::gaussianBlur(const Image& input, Image& output, int kernel)
+/************************************************************************
+* Half of a 1D gaussian kernel, center tap first.
+* The kernel is symmetric, so weights[i] applies at both -i and +i.
+************************************************************************/
+std::vector<float> gaussianWeights(int kernel)
 {
-    temp1.resize(input.width, input.height);
-    output.resize(input.width, input.height);
-    if (kernel % 2 == 0)
-    {
-        kernel++;
-    }
     int offset = int(kernel / 2);
-    // Just make one corner of the kernel
-    std::vector<float> convolution(offset + 1, 0);
+    std::vector<float> weights(offset + 1, 0);
     float stdev = float(kernel - 1) / 6.0f;
     float one_over_sqrt_2_pi_stdevsqrd = 1.0f/sqrt(2.0f * std::numbers::pi * stdev * stdev);
     for (int x = 0; x <= +offset; x++)
     {
-        convolution[x] = one_over_sqrt_2_pi_stdevsqrd * exp(- (x * x) / (2.0f * stdev * stdev));
+        weights[x] = one_over_sqrt_2_pi_stdevsqrd * exp(- (x * x) / (2.0f * stdev * stdev));
+    }
+    return weights;
+}
+
+/************************************************************************
+* Horizontal blur of one row, written into rowOut.
+*
+* Rows are treated as flat float arrays (4 floats per pixel) so that every
+* tap is a contiguous multiply-add the compiler can vectorize.
+* Only the first and last `offset` pixels need clamped taps, the interior
+* reads its neighbors directly. Alpha is blurred along with rgb and must
+* be restored by the caller.
+************************************************************************/
+static void blurRow(const float* rowIn, float* rowOut, int width, const std::vector<float>& weights)
+{
+    int offset = int(weights.size()) - 1;
+    int interiorStart = std::min(offset, width);
+    int interiorEnd = std::max(interiorStart, width - offset);
+
+    // Clamp-free interior, one tap at a time across the whole span
+    int start = NUM_CHANNELS * interiorStart;
+    int end = NUM_CHANNELS * interiorEnd;
+    for (int f = start; f < end; f++)
+    {
+        rowOut[f] = weights[0] * rowIn[f];
+    }
+    for (int i = 1; i <= offset; i++)
+    {
+        const float w = weights[i];
+        const float* left = rowIn - NUM_CHANNELS * i;
+        const float* right = rowIn + NUM_CHANNELS * i;
+        for (int f = start; f < end; f++)
+        {
+            rowOut[f] += w * (left[f] + right[f]);
+        }
     }
-    for (int x = 0; x < input.width; x++)
+
+    // Borders, where taps are clamped to the edge pixel
+    auto border = [&](int x)
     {
-        for (int y = 0; y < input.height; y++)
+        for (int c = 0; c < NUM_CHANNELS; c++)
         {
-            temp1(x, y) = { 0.0f, 0.0f, 0.0f, input(x, y).a };
-            for (int i = -offset; i <= +offset; i++)
+            float sum = weights[0] * rowIn[NUM_CHANNELS * x + c];
+            for (int i = 1; i <= offset; i++)
             {
-                temp1(x, y).r += convolution[std::abs(i)] * input.clamped(x + i, y).r;
-                temp1(x, y).g += convolution[std::abs(i)] * input.clamped(x + i, y).g;
-                temp1(x, y).b += convolution[std::abs(i)] * input.clamped(x + i, y).b;
+                int left = clamp(x - i, 0, width - 1);
+                int right = clamp(x + i, 0, width - 1);
+                sum += weights[i] * (rowIn[NUM_CHANNELS * left + c] + rowIn[NUM_CHANNELS * right + c]);
             }
+            rowOut[NUM_CHANNELS * x + c] = sum;
         }
+    };
+    for (int x = 0; x < interiorStart; x++)
+    {
+        border(x);
     }
-    for (int x = 0; x < input.width; x++)
+    for (int x = interiorEnd; x < width; x++)
     {
-        for (int y = 0; y < input.height; y++)
+        border(x);
+    }
+}
+
+/************************************************************************
+* Separable gaussian blur on rgb, alpha is passed through.
+*
+* The horizontal pass walks each row contiguously into a row buffer, so
+* in == temp1 is fine. The vertical pass is done in column strips narrow
+* enough that all rows under the kernel stay in cache while the strip is
+* swept top to bottom, with row clamping done once per tap per row rather
+* than per pixel. Both passes split the rows into bands across the
+* thread pool.
+************************************************************************/
+void ImagePipeline::gaussianBlur(const Image& input, Image& output, int kernel)
+{
+    if (kernel % 2 == 0)
+    {
+        kernel++;
+    }
+    std::vector<float> weights = gaussianWeights(kernel);
+    int offset = int(weights.size()) - 1;
+    int width = input.width;
+    int height = input.height;
+    int rowFloats = NUM_CHANNELS * width;
+
+    // Horizontal pass, input -> temp1
+    temp1.resize(width, height);
+    parallelRows(height, [&](int y0, int y1)
+    {
+        std::vector<col4f>& row = threadRow(0, width);
+        float* rowOut = reinterpret_cast<float*>(row.data());
+        for (int y = y0; y < y1; y++)
+        {
+            const float* rowIn = reinterpret_cast<const float*>(&input(0, y));
+            blurRow(rowIn, rowOut, width, weights);
+            for (int x = 0; x < width; x++)
+            {
+                row[x].a = input(x, y).a;
+            }
+            std::memcpy(reinterpret_cast<float*>(&temp1(0, y)), rowOut, rowFloats * sizeof(float));
+        }
+    });
+
+    // Vertical pass, temp1 -> output, in strips of columns
+    output.resize(width, height);
+    int stripWidth = clamp(BLUR_STRIP_BYTES / int(sizeof(col4f) * (2 * offset + 1)), 16, std::max(width, 16));
+    const float* src = reinterpret_cast<const float*>(temp1.buffer.data());
+    float* dst = reinterpret_cast<float*>(output.buffer.data());
+    parallelRows(height, [&](int y0, int y1)
+    {
+        for (int stripStart = 0; stripStart < width; stripStart += stripWidth)
         {
-            output(x, y) = { 0.0f, 0.0f, 0.0f, input(x, y).a };
-            for (int j = -offset; j <= +offset; j++)
+            int start = NUM_CHANNELS * stripStart;
+            int end = NUM_CHANNELS * std::min(stripStart + stripWidth, width);
+            for (int y = y0; y < y1; y++)
             {
-                output(x, y).r += convolution[std::abs(j)] * temp1.clamped(x, y + j).r;
-                output(x, y).g += convolution[std::abs(j)] * temp1.clamped(x, y + j).g;
-                output(x, y).b += convolution[std::abs(j)] * temp1.clamped(x, y + j).b;
+                float* out = dst + y * rowFloats;
+                const float* center = src + y * rowFloats;
+                for (int f = start; f < end; f++)
+                {
+                    out[f] = weights[0] * center[f];
+                }
+                for (int j = 1; j <= offset; j++)
+                {
+                    const float w = weights[j];
+                    const float* up = src + clamp(y - j, 0, height - 1) * rowFloats;
+                    const float* down = src + clamp(y + j, 0, height - 1) * rowFloats;
+                    for (int f = start; f < end; f++)
+                    {
+                        out[f] += w * (up[f] + down[f]);
+                    }
+                }
+                for (int f = start + 3; f < end; f += NUM_CHANNELS)
+                {
+                    out[f] = center[f];
+                }
             }
         }
+    });
+}
+
+/************************************************************************
+* gaussianBlur on half storage, the same two passes. Each row is widened
+* into a row buffer, blurred in float and narrowed into halfTemp1. The
+* vertical pass widens the rows under the kernel a strip at a time and
+* sums them in float, so a pixel is rounded to half once per pass.
+* Alpha is passed through as the stored halves.
+************************************************************************/
+void ImagePipeline::gaussianBlur(const HalfImage& input, HalfImage& output, int kernel)
+{
+    if (kernel % 2 == 0)
+    {
+        kernel++;
     }
+    std::vector<float> weights = gaussianWeights(kernel);
+    int offset = int(weights.size()) - 1;
+    int width = input.width;
+    int height = input.height;
+
+    // Horizontal pass, input -> halfTemp1
+    halfTemp1.resize(width, height);
+    parallelRows(height, [&](int y0, int y1)
+    {
+        std::vector<col4f>& rowIn = threadRow(0, width);
+        std::vector<col4f>& rowOut = threadRow(1, width);
+        for (int y = y0; y < y1; y++)
+        {
+            widenPixels(&input(0, y), rowIn.data(), width);
+            blurRow(reinterpret_cast<const float*>(rowIn.data()), reinterpret_cast<float*>(rowOut.data()), width, weights);
+            narrowPixels(rowOut.data(), &halfTemp1(0, y), width);
+            for (int x = 0; x < width; x++)
+            {
+                halfTemp1(x, y).a = input(x, y).a;
+            }
+        }
+    });
+
+    // Vertical pass, halfTemp1 -> output, in strips of columns
+    output.resize(width, height);
+    int stripWidth = clamp(BLUR_STRIP_BYTES / int(sizeof(col4h) * (2 * offset + 1)), 16, std::max(width, 16));
+    parallelRows(height, [&](int y0, int y1)
+    {
+        std::vector<col4f>& sumRow = threadRow(0, stripWidth);
+        std::vector<col4f>& tapRow = threadRow(1, 2 * stripWidth);
+        float* sum = reinterpret_cast<float*>(sumRow.data());
+        float* up = reinterpret_cast<float*>(tapRow.data());
+        float* down = up + NUM_CHANNELS * stripWidth;
+        for (int stripStart = 0; stripStart < width; stripStart += stripWidth)
+        {
+            int count = std::min(stripWidth, width - stripStart);
+            int floats = NUM_CHANNELS * count;
+            for (int y = y0; y < y1; y++)
+            {
+                widenPixels(&halfTemp1(stripStart, y), sumRow.data(), count);
+                for (int f = 0; f < floats; f++)
+                {
+                    sum[f] *= weights[0];
+                }
+                for (int j = 1; j <= offset; j++)
+                {
+                    const float w = weights[j];
+                    widenPixels(&halfTemp1(stripStart, clamp(y - j, 0, height - 1)), tapRow.data(), count);
+                    widenPixels(&halfTemp1(stripStart, clamp(y + j, 0, height - 1)), tapRow.data() + stripWidth, count);
+                    for (int f = 0; f < floats; f++)
+                    {
+                        sum[f] += w * (up[f] + down[f]);
+                    }
+                }
+                narrowPixels(sumRow.data(), &output(stripStart, y), count);
+                for (int x = stripStart; x < stripStart + count; x++)
+                {
+                    output(x, y).a = halfTemp1(x, y).a;
+                }
+            }
+        }
+    });
 }
 
-void ImagePipeline::gaussianDeBlur(const Image& input, Image& output, int kernel)
+/************************************************************************
+* Radii of three stacked box blurs whose combined variance matches the
+* gaussian gaussianWeights(kernel) describes, after Kutskir's
+* "Fastest Gaussian Blur".
+************************************************************************/
+std::vector<int> gaussianBoxRadii(int kernel)
 {
-    temp1.resize(input.width, input.height);
-    output.resize(input.width, input.height);
     if (kernel % 2 == 0)
     {
         kernel++;
     }
-    int offset = int(kernel / 2);
-    // Just make one corner of the kernel
-    std::vector<float> convolution(offset + 1, 0);
+    const int passes = 3;
     float stdev = float(kernel - 1) / 6.0f;
-    float one_over_sqrt_2_pi_stdevsqrd = 1.0f/sqrt(2.0f * std::numbers::pi * stdev * stdev);
-    for (int x = 0; x <= +offset; x++)
+    int lower = int(sqrt(12.0f * stdev * stdev / passes + 1.0f));
+    if (lower % 2 == 0)
+    {
+        lower--;
+    }
+    int upper = lower + 2;
+    float ideal = (12.0f * stdev * stdev - passes * lower * lower - 4 * passes * lower - 3 * passes) / (-4.0f * lower - 4.0f);
+    int lowerPasses = int(std::round(ideal));
+    std::vector<int> radii(passes);
+    for (int i = 0; i < passes; i++)
     {
-        convolution[x] = one_over_sqrt_2_pi_stdevsqrd * exp(- (x * x) / (2.0f * stdev * stdev));
+        radii[i] = ((i < lowerPasses) ? lower : upper) / 2;
     }
-    SquareMatrix rowMat(input.width);
-    SquareMatrix colMat(input.height);
-    for (int x = 0; x < rowMat.side; x++)
+    return radii;
+}
+
+void ImagePipeline::gaussianBlur(const Image& input, Image& output, int kernel, BlurMode mode)
+{
+    switch (mode)
     {
-        for (int y = 0; y < rowMat.side; y++)
+        case BlurMode::Box:
         {
-            rowMat(x, y) = 0.0f;
+            std::vector<int> radii = gaussianBoxRadii(kernel);
+            stackedBoxBlur(input, output, radii.data(), int(radii.size()));
+            break;
         }
+        case BlurMode::Exact:
+        default:
+            gaussianBlur(input, output, kernel);
+            break;
     }
-    for (int x = 0; x < rowMat.side; x++)
+}
+
+int blurReach(int kernel, BlurMode mode)
+{
+    if (mode == BlurMode::Box)
     {
-        for (int y = 0; y < rowMat.side; y++)
+        std::vector<int> radii = gaussianBoxRadii(kernel);
+        return radii[0] + radii[1] + radii[2];
+    }
+    return ((kernel % 2 == 0) ? kernel + 1 : kernel) / 2;
+}
+
+void ImagePipeline::gaussianBlur(const Image& input, Image& output, int kernel, BlurMode mode, Rect region)
+{
+    output.resize(input.width, input.height);
+    gaussianBlur(view(input), view(output), input.width, input.height, kernel, mode, region);
+}
+
+/************************************************************************
+* Blur only the pixels inside region, the rest of output is left as is.
+*
+* Crops region plus the blur's reach out of in, blurs the crop and copies
+* region back. Where the crop stops at the frame edge the blur clamps
+* exactly as the full blur would, everywhere else region sits at least
+* the reach away from the crop edge, so region matches a full blur.
+************************************************************************/
+void ImagePipeline::gaussianBlur(ConstImageView input, ImageView output, int width, int height, int kernel, BlurMode mode, Rect region)
+{
+    Rect bounds = { 0, 0, width, height };
+    region = intersect(region, bounds);
+    if (region.empty())
+    {
+        return;
+    }
+    Rect source = intersect(expand(region, blurReach(kernel, mode)), bounds);
+    regionIn.resize(source.width(), source.height());
+    for (int y = source.y0; y < source.y1; y++)
+    {
+        const col4f* row = input.at(source.x0, y);
+        std::copy(row, row + source.width(), &regionIn(0, y - source.y0));
+    }
+    gaussianBlur(regionIn, regionOut, kernel, mode);
+    for (int y = region.y0; y < region.y1; y++)
+    {
+        const col4f* row = &regionOut(region.x0 - source.x0, y - source.y0);
+        std::copy(row, row + region.width(), output.at(region.x0, y));
+    }
+}
+
+void ImagePipeline::boxBlur(const Image& input, Image& output, int radius)
+{
+    stackedBoxBlur(input, output, &radius, 1);
+}
+
+/************************************************************************
+* Sliding window box average of one row, window [x - radius, x + radius]
+* with edge pixels repeated. All four channels slide together, alpha is
+* averaged too and the caller restores it.
+************************************************************************/
+static void boxBlurRow(const float* rowIn, float* rowOut, int width, int radius)
+{
+    float scale = 1.0f / float(2 * radius + 1);
+    int last = width - 1;
+    float sum[NUM_CHANNELS];
+    for (int c = 0; c < NUM_CHANNELS; c++)
+    {
+        sum[c] = float(radius + 1) * rowIn[c];
+    }
+    for (int i = 1; i <= radius; i++)
+    {
+        const float* pixel = rowIn + NUM_CHANNELS * std::min(i, last);
+        for (int c = 0; c < NUM_CHANNELS; c++)
         {
-            for (int i = -offset; i <= +offset; i++)
-            if (x == y && x + i >= 0 && x + i < rowMat.side)
-            {
-                rowMat(y, x + i) = convolution[std::abs(i)];
-            }
+            sum[c] += pixel[c];
         }
     }
-    for (int x = 0; x < colMat.side; x++)
+    for (int x = 0; x < width; x++)
     {
-        for (int y = 0; y < colMat.side; y++)
+        const float* entering = rowIn + NUM_CHANNELS * std::min(x + radius + 1, last);
+        const float* leaving = rowIn + NUM_CHANNELS * std::max(x - radius, 0);
+        float* out = rowOut + NUM_CHANNELS * x;
+        for (int c = 0; c < NUM_CHANNELS; c++)
         {
-            for (int i = -offset; i <= +offset; i++)
-            if (x == y && x + i >= 0 && x + i < colMat.side)
-            {
-                colMat(y, x + i) = convolution[std::abs(i)];
-            }
+            out[c] = sum[c] * scale;
+            sum[c] += entering[c] - leaving[c];
         }
     }
-    SquareMatrix rowMatInverse = rowMat.findInverse();
-    SquareMatrix colMatInverse = colMat.findInverse();
-    for (int x = 0; x < 20; x++)
+}
+
+/************************************************************************
+* Sliding window box average down columns [x0, x1) of src into dst.
+* A row of running sums slides down the image, so every read and write
+* is a contiguous span. Alpha is copied from src.
+************************************************************************/
+static void boxBlurColumns(const Image& src, Image& dst, int radius, float* sum, int x0, int x1)
+{
+    int rowFloats = NUM_CHANNELS * src.width;
+    int spanFloats = NUM_CHANNELS * (x1 - x0);
+    int last = src.height - 1;
+    float scale = 1.0f / float(2 * radius + 1);
+    const float* in = reinterpret_cast<const float*>(src.buffer.data()) + NUM_CHANNELS * x0;
+    float* out = reinterpret_cast<float*>(dst.buffer.data()) + NUM_CHANNELS * x0;
+    for (int f = 0; f < spanFloats; f++)
+    {
+        sum[f] = float(radius + 1) * in[f];
+    }
+    for (int j = 1; j <= radius; j++)
     {
-        for (int y = 0; y < 10; y++)
+        const float* row = in + std::min(j, last) * rowFloats;
+        for (int f = 0; f < spanFloats; f++)
         {
-            std::cout << std::fixed << std::setprecision(3) << rowMat(y, x) << " , ";
+            sum[f] += row[f];
         }
-        std::cout << std::endl;
     }
-    for (int x = 0; x < 50; x++)
+    for (int y = 0; y < src.height; y++)
     {
-        for (int y = 0; y < 25; y++)
+        float* outRow = out + y * rowFloats;
+        const float* center = in + y * rowFloats;
+        const float* entering = in + std::min(y + radius + 1, last) * rowFloats;
+        const float* leaving = in + std::max(y - radius, 0) * rowFloats;
+        for (int f = 0; f < spanFloats; f++)
+        {
+            outRow[f] = sum[f] * scale;
+            sum[f] += entering[f] - leaving[f];
+        }
+        for (int f = 3; f < spanFloats; f += NUM_CHANNELS)
         {
-            std::cout << std::fixed << std::setprecision(3) << rowMatInverse(y, x) << " , ";
+            outRow[f] = center[f];
         }
-        std::cout << std::endl;
     }
+}
 
-    // Row deblur
-    for (int imgRow = 0; imgRow < input.height; imgRow++)
+/************************************************************************
+* One or more box blurs applied back to back, rgb only.
+* Cost per pixel is independent of the radii.
+*
+* Every horizontal pass for a row happens while the row is in L1, then
+* the vertical passes ping-pong between temp1 and output, starting on
+* whichever one makes the last pass land in output. Rows are split
+* across the thread pool for the horizontal passes and columns for the
+* vertical ones.
+************************************************************************/
+void ImagePipeline::stackedBoxBlur(const Image& input, Image& output, const int* radii, int passes)
+{
+    int width = input.width;
+    int height = input.height;
+    int rowFloats = NUM_CHANNELS * width;
+    temp1.resize(width, height);
+    output.resize(width, height);
+
+    // Horizontal passes, input -> first
+    Image* first = (passes % 2 == 1) ? &temp1 : &output;
+    Image* second = (passes % 2 == 1) ? &output : &temp1;
+    parallelRows(height, [&](int y0, int y1)
     {
-        // Matrix row
-        for (int matRow = 0; matRow < rowMatInverse.side; matRow++)
+        float* rowA = reinterpret_cast<float*>(threadRow(0, width).data());
+        float* rowB = reinterpret_cast<float*>(threadRow(1, width).data());
+        for (int y = y0; y < y1; y++)
         {
-            temp1(matRow, imgRow) = col4f(0.0f, 0.0f, 0.0f, input(matRow, imgRow).a);
-            // Matrix col
-            for (int matCol = 0; matCol < rowMatInverse.side; matCol++)
+            float* rowIn = rowA;
+            float* rowOut = rowB;
+            std::memcpy(rowIn, reinterpret_cast<const float*>(&input(0, y)), rowFloats * sizeof(float));
+            for (int i = 0; i < passes; i++)
+            {
+                boxBlurRow(rowIn, rowOut, width, radii[i]);
+                std::swap(rowIn, rowOut);
+            }
+            float* dst = reinterpret_cast<float*>(&(*first)(0, y));
+            const float* src = reinterpret_cast<const float*>(&input(0, y));
+            for (int f = 0; f < rowFloats; f++)
             {
-                temp1(matRow, imgRow).r += input(matCol, imgRow).r * rowMatInverse(matRow, matCol);
-                temp1(matRow, imgRow).g += input(matCol, imgRow).g * rowMatInverse(matRow, matCol);
-                temp1(matRow, imgRow).b += input(matCol, imgRow).b * rowMatInverse(matRow, matCol);
+                dst[f] = rowIn[f];
+            }
+            for (int f = 3; f < rowFloats; f += NUM_CHANNELS)
+            {
+                dst[f] = src[f];
             }
         }
+    });
+
+    // Vertical passes, each column span slides down on its own
+    for (int i = 0; i < passes; i++)
+    {
+        threadPool().parallelFor(width, COLUMN_GRAIN, [&](int x0, int x1)
+        {
+            float* sum = reinterpret_cast<float*>(threadRow(0, x1 - x0).data());
+            boxBlurColumns(*first, *second, radii[i], sum, x0, x1);
+        });
+        std::swap(first, second);
     }
-    // Col deblur
-    for (int imgCol = 0; imgCol < input.width; imgCol++)
+}
+
+/************************************************************************
+* The matrix gaussianBlur applies along a row or column of length side,
+* including the edge clamping, as a banded matrix.
+************************************************************************/
+static BandedMatrix blurMatrix(int side, const std::vector<float>& weights)
+{
+    int offset = int(weights.size()) - 1;
+    BandedMatrix blur(side, offset);
+    for (int i = 0; i < side; i++)
     {
-        // Matrix row
-        for (int matRow = 0; matRow < colMatInverse.side; matRow++)
+        for (int t = -offset; t <= +offset; t++)
         {
-            output(imgCol, matRow) = col4f(0.0f, 0.0f, 0.0f, temp1(imgCol, matRow).a);
-            // Matrix col
-            for (int matCol = 0; matCol < colMatInverse.side; matCol++)
+            blur(i, clamp(i + t, 0, side - 1)) += weights[std::abs(t)];
+        }
+    }
+    return blur;
+}
+
+void ImagePipeline::gaussianDeBlur(const Image& input, Image& output, int kernel)
+{
+    gaussianDeBlur(input, output, kernel, DEBLUR_REGULARIZATION);
+}
+
+/************************************************************************
+* out = in transposed, in 16x16 blocks so that both the reads and the
+* writes stay within a handful of cache lines.
+************************************************************************/
+static void transpose(const Image& input, Image& output)
+{
+    const int block = 16;
+    output.resize(input.height, input.width);
+    int blockRows = (input.height + block - 1) / block;
+    parallelRows(blockRows, [&](int blockRow0, int blockRow1)
+    {
+        for (int by = blockRow0 * block; by < std::min(blockRow1 * block, input.height); by += block)
+        {
+            for (int bx = 0; bx < input.width; bx += block)
             {
-                output(imgCol, matRow).r += temp1(imgCol, matCol).r * colMatInverse(matRow, matCol);
-                output(imgCol, matRow).g += temp1(imgCol, matCol).g * colMatInverse(matRow, matCol);
-                output(imgCol, matRow).b += temp1(imgCol, matCol).b * colMatInverse(matRow, matCol);
+                int yEnd = std::min(by + block, input.height);
+                int xEnd = std::min(bx + block, input.width);
+                for (int y = by; y < yEnd; y++)
+                {
+                    for (int x = bx; x < xEnd; x++)
+                    {
+                        output(y, x) = input(x, y);
+                    }
+                }
             }
         }
+    });
+}
+
+/************************************************************************
+* Undo gaussianBlur on rgb, alpha is passed through.
+*
+* Blurring a row is x -> Ax for a banded A. A itself is too close to
+* singular to invert, so each pass solves the Tikhonov regularized
+* least squares problem ((A^T)A + lambda * I)x = (A^T)b instead, with a
+* banded Cholesky factorization done once per pass. Larger lambda is
+* more robust to noise and quantization, smaller is sharper.
+*
+* Solves run down columns with whole image rows as the unknowns, so every
+* inner loop is a contiguous row. The row pass does the same on the
+* transposed image. Columns are independent, so each pass splits them
+* into spans across the thread pool.
+************************************************************************/
+void ImagePipeline::gaussianDeBlur(const Image& input, Image& output, int kernel, float regularization)
+{
+    if (kernel % 2 == 0)
+    {
+        kernel++;
+    }
+    std::vector<float> weights = gaussianWeights(kernel);
+    int width = input.width;
+    int height = input.height;
+
+    BandedMatrix rowBlur = blurMatrix(width, weights);
+    BandedMatrix colBlur = blurMatrix(height, weights);
+    BandedMatrix rowSolver = rowBlur.normalProduct(regularization);
+    BandedMatrix colSolver = colBlur.normalProduct(regularization);
+    if (!rowSolver.choleskyFactor() || !colSolver.choleskyFactor())
+    {
+        output.read(input);
+        return;
+    }
+
+    // Row deblur, input -> temp1, solved transposed in temp2
+    transpose(input, temp1);
+    temp2.resize(height, width);
+    int transposedFloats = NUM_CHANNELS * height;
+    parallelColumns(height, [&](int f0, int f1)
+    {
+        rowBlur.transposeMultiply(reinterpret_cast<const float*>(temp1.buffer.data()) + f0,
+                                  reinterpret_cast<float*>(temp2.buffer.data()) + f0,
+                                  f1 - f0, transposedFloats);
+        rowSolver.choleskySolve(reinterpret_cast<float*>(temp2.buffer.data()) + f0, f1 - f0, transposedFloats);
+    });
+    transpose(temp2, temp1);
+    for (int i = 0; i < temp1.pixelCount; i++)
+    {
+        temp1[i].a = input[i].a;
+    }
+
+    // Col deblur, temp1 -> output
+    output.resize(width, height);
+    int rowFloats = NUM_CHANNELS * width;
+    parallelColumns(width, [&](int f0, int f1)
+    {
+        colBlur.transposeMultiply(reinterpret_cast<const float*>(temp1.buffer.data()) + f0,
+                                  reinterpret_cast<float*>(output.buffer.data()) + f0,
+                                  f1 - f0, rowFloats);
+        colSolver.choleskySolve(reinterpret_cast<float*>(output.buffer.data()) + f0, f1 - f0, rowFloats);
+    });
+    for (int i = 0; i < output.pixelCount; i++)
+    {
+        output[i].a = temp1[i].a;
     }
 }
 
 void ImagePipeline::bloom(const Image& input, Image& output, float threshold, int kernel, float strength)
 {
-    thresholdColor(input, temp1, threshold);
-    gaussianBlur(temp1, temp2, kernel);
-    scaleBrightness(temp2, temp2, strength);
-    add(input, temp2, output);
+    bloom(input, output, threshold, kernel, strength, BlurMode::Exact);
+}
+
+void ImagePipeline::bloom(const Image& input, Image& output, float threshold, int kernel, float strength, BlurMode mode)
+{
+    // gaussianBlur needs temp1 for itself
+    thresholdColor(input, temp2, threshold);
+    gaussianBlur(temp2, temp3, kernel, mode);
+    scaleBrightness(temp3, temp3, strength);
+    add(input, temp3, output);
+}
+
+void ImagePipeline::bloom(const HalfImage& input, HalfImage& output, float threshold, int kernel, float strength)
+{
+    // gaussianBlur needs halfTemp1 for itself
+    PointChain bright;
+    bright.thresholdColor(threshold);
+    apply(bright, input, halfTemp2);
+    gaussianBlur(halfTemp2, halfTemp2, kernel);
+    output.resize(input.width, input.height);
+    parallelRows(input.height, [&](int y0, int y1)
+    {
+        std::vector<col4f>& rowIn = threadRow(0, input.width);
+        std::vector<col4f>& glow = threadRow(1, input.width);
+        for (int y = y0; y < y1; y++)
+        {
+            widenPixels(&input(0, y), rowIn.data(), input.width);
+            widenPixels(&halfTemp2(0, y), glow.data(), input.width);
+            for (int x = 0; x < input.width; x++)
+            {
+                glow[x] = rowIn[x] + strength * glow[x];
+            }
+            narrowPixels(glow.data(), &output(0, y), input.width);
+        }
+    });
 }
 
 // For now, both images start at 0, 0
@@ -645,84 +1170,162 @@ void ImagePipeline::add(const Image& fg, const Image& bg, Image& output)
 void ImagePipeline::maskify(const Image& imgIn, Image& maskOut)
 {
     maskOut.resize(imgIn.width, imgIn.height);
-    for (int i = 0; i < imgIn.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = imgIn.buffer.data();
+    col4f* out = maskOut.buffer.data();
+    parallelPixels(imgIn.pixelCount, [&](int begin, int end)
     {
-        maskOut[i] = col4f(0.0f, 0.0f, 0.0f, brightness(imgIn[i]));
-    }
+        kernels.maskify(in + begin, out + begin, end - begin);
+    });
 }
 
 void ImagePipeline::horizontalMask(Image& maskOut, float t, int feathering, int width, int height)
+{
+    horizontalMask(maskOut, t, feathering, width, height, { 0, 0, width, height });
+}
+
+void ImagePipeline::verticalMask(Image& maskOut, float t, int feathering, int width, int height)
+{
+    verticalMask(maskOut, t, feathering, width, height, { 0, 0, width, height });
+}
+
+void ImagePipeline::circleMask(Image& maskOut, float t, int feathering, int width, int height)
+{
+    circleMask(maskOut, t, feathering, width, height, { 0, 0, width, height });
+}
+
+void ImagePipeline::perlinNoiseMask(Image& maskOut, float frequency, float z, int width, int height)
+{
+    perlinNoiseMask(maskOut, frequency, z, width, height, { 0, 0, width, height });
+}
+
+// Region overloads only write the pixels inside region, the rest of
+// maskOut is left as it was.
+void ImagePipeline::horizontalMask(Image& maskOut, float t, int feathering, int width, int height, Rect region)
 {
     maskOut.resize(width, height);
+    horizontalMask(view(maskOut), t, feathering, width, height, region);
+}
+
+void ImagePipeline::horizontalMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region)
+{
+    region = intersect(region, { 0, 0, width, height });
     int cutoff = clamp(int(float(width) * t), 0, width);
-    for (int x = 0; x < width; x++)
+    parallelRows(region.height(), [&](int y0, int y1)
     {
-        for (int y = 0; y < height; y++)
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
         {
-            maskOut(x, y) = col4f(0.0f, 0.0f, 0.0f, linear_interpolation((float(x) - cutoff) / feathering + 0.5f, 0.0f, 1.0f));
+            for (int x = region.x0; x < region.x1; x++)
+            {
+                *maskOut.at(x, y) = col4f(0.0f, 0.0f, 0.0f, clerp((float(x) - cutoff) / feathering + 0.5f, 0.0f, 1.0f));
+            }
         }
-    }
+    });
 }
 
-void ImagePipeline::verticalMask(Image& maskOut, float t, int feathering, int width, int height)
+void ImagePipeline::verticalMask(Image& maskOut, float t, int feathering, int width, int height, Rect region)
 {
     maskOut.resize(width, height);
+    verticalMask(view(maskOut), t, feathering, width, height, region);
+}
+
+void ImagePipeline::verticalMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region)
+{
+    region = intersect(region, { 0, 0, width, height });
     int cutoff = clamp(int(float(height) * t), 0, height);
-    for (int x = 0; x < width; x++)
+    parallelRows(region.height(), [&](int y0, int y1)
     {
-        for (int y = 0; y < height; y++)
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
         {
-            maskOut(x, y) = col4f(0.0f, 0.0f, 0.0f, linear_interpolation((float(y) - cutoff) / feathering + 0.5f, 0.0f, 1.0f));
+            for (int x = region.x0; x < region.x1; x++)
+            {
+                *maskOut.at(x, y) = col4f(0.0f, 0.0f, 0.0f, clerp((float(y) - cutoff) / feathering + 0.5f, 0.0f, 1.0f));
+            }
         }
-    }
+    });
 }
 
-void ImagePipeline::circleMask(Image& maskOut, float t, int feathering, int width, int height)
+void ImagePipeline::circleMask(Image& maskOut, float t, int feathering, int width, int height, Rect region)
 {
     maskOut.resize(width, height);
+    circleMask(view(maskOut), t, feathering, width, height, region);
+}
+
+void ImagePipeline::circleMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region)
+{
+    region = intersect(region, { 0, 0, width, height });
     int centerX = width / 2;
     int centerY = height / 2;
     float finalRadius = sqrt(width * width + height * height) / 2.0f;
     int cutoff = clamp(finalRadius * t, 0.0f, finalRadius);
-    for (int x = 0; x < width; x++)
+    parallelRows(region.height(), [&](int y0, int y1)
     {
-        for (int y = 0; y < height; y++)
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
         {
-            maskOut(x, y) =
-            col4f(
-                0.0f,
-                0.0f,
-                0.0f,
-                linear_interpolation(
-                    (sqrt((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY)) - cutoff) / feathering + 0.5f,
+            for (int x = region.x0; x < region.x1; x++)
+            {
+                *maskOut.at(x, y) =
+                col4f(
+                    0.0f,
+                    0.0f,
                     0.0f,
-                    1.0f
-                    )
-            );
+                    clerp(
+                        (sqrt((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY)) - cutoff) / feathering + 0.5f,
+                        0.0f,
+                        1.0f
+                        )
+                );
+            }
         }
-    }
+    });
 }
 
-void ImagePipeline::perlinNoiseMask(Image& maskOut, float frequency, float z, int width, int height)
+void ImagePipeline::perlinNoiseMask(Image& maskOut, float frequency, float z, int width, int height, Rect region)
 {
-    static PerlinState perlin;
     maskOut.resize(width, height);
-    for (int x = 0; x < width; x++)
+    perlinNoiseMask(view(maskOut), frequency, z, width, height, region);
+}
+
+void ImagePipeline::perlinNoiseMask(ImageView maskOut, float frequency, float z, int width, int height, Rect region)
+{
+    static PerlinState perlin;
+    region = intersect(region, { 0, 0, width, height });
+    parallelRows(region.height(), [&](int y0, int y1)
     {
-        for (int y = 0; y < height; y++)
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
         {
-            // Normalize noise from [0, 1] to [0, width)
-            vec3 point = vec3(x, y, z) * (frequency / float(width));
-            maskOut(x, y) = col4f(0.0f, 0.0f, 0.0f, perlin.noise(point));
+            for (int x = region.x0; x < region.x1; x++)
+            {
+                // Normalize noise from [0, 1] to [0, width)
+                vec3 point = vec3(x, y, z) * (frequency / float(width));
+                *maskOut.at(x, y) = col4f(0.0f, 0.0f, 0.0f, perlin.noise(point));
+            }
         }
-    }
+    });
 }
 
 void ImagePipeline::composite(const Image& imgIn1, const Image& imgIn2, Image& imgOut, const Image& mask)
 {
     imgOut.resize(imgIn1.width, imgIn1.height);
-    for (int i = 0; i < imgIn1.pixelCount; i++)
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in1 = imgIn1.buffer.data();
+    const col4f* in2 = imgIn2.buffer.data();
+    const col4f* alpha = mask.buffer.data();
+    col4f* out = imgOut.buffer.data();
+    parallelPixels(imgIn1.pixelCount, [&](int begin, int end)
     {
-        imgOut[i] = imgIn1[i] * mask[i].a + imgIn2[i] * (1.0f - mask[i].a);
-    }
+        kernels.composite(in1 + begin, in2 + begin, alpha + begin, out + begin, end - begin);
+    });
+}
+
+void ImagePipeline::composite(ConstImageView imgIn1, ConstImageView imgIn2, ImageView imgOut, ConstImageView mask, Rect region)
+{
+    const PixelKernels& kernels = pixelKernels();
+    parallelRows(region.height(), [&](int y0, int y1)
+    {
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
+        {
+            kernels.composite(imgIn1.at(region.x0, y), imgIn2.at(region.x0, y), mask.at(region.x0, y), imgOut.at(region.x0, y), region.width());
+        }
+    });
 }
@@ -14,13 +14,26 @@
 #include <iostream>
 #include <cmath>
 #include <numbers>
+#include <string>
 #include <vector>
 
+#include "byte-image.h"
 #include "color.h"
+#include "half-image.h"
+#include "planar-image.h"
+#include "point-chain.h"
 
 const int NUM_CHANNELS = 4;
 
+// Target working set for one column strip of a vertical blur pass,
+// roughly the size of a per-core L2.
+const int BLUR_STRIP_BYTES = 256 * 1024;
+
 std::string fileName(std::string stem, int frame, std::string extension);
+// Half of a 1D gaussian kernel, center tap first
+std::vector<float> gaussianWeights(int kernel);
+// Radii of the three box blurs BlurMode::Box uses for a kernel
+std::vector<int> gaussianBoxRadii(int kernel);
 
 // Handles file I/O, dynamic sizing, single-image storing.
 class Image
@@ -38,9 +51,9 @@ public:
     //~Image();
     //const bool null() const; // Check if buffer is nullptr
     void resize(int width, int height);
-    void read(const char* filename); // Load image from file
+    bool read(const char* filename); // Load image from file, false on failure
     void read(const Image& image); // Copy image from other image
-    void write(const char* filename); // Write image to file
+    bool write(const char* filename) const; // Write image to file, false on failure
     // For the following: 0 <= tx <= width - 1, 0 <= ty <= height - 1
     col4f nearestNeighbor(float tx, float ty);
     col4f bilinearInterpolation(float tx, float ty);
@@ -101,6 +114,80 @@ public:
     */
 };
 
+/************************************************************************
+* Non-owning windows onto pixel storage in full-frame coordinates. Pixel
+* (x, y) lives at data[(y - y0) * stride + (x - x0)], so a whole Image
+* and a tile cut out of one are indexed the same way.
+************************************************************************/
+struct ImageView
+{
+    col4f* data;
+    int stride;
+    int x0;
+    int y0;
+
+    inline col4f* at(int x, int y) const { return data + ptrdiff_t(y - y0) * stride + (x - x0); }
+};
+
+struct ConstImageView
+{
+    const col4f* data;
+    int stride;
+    int x0;
+    int y0;
+
+    ConstImageView(const col4f* data, int stride, int x0, int y0) : data(data), stride(stride), x0(x0), y0(y0) {}
+    ConstImageView(ImageView view) : data(view.data), stride(view.stride), x0(view.x0), y0(view.y0) {}
+
+    inline const col4f* at(int x, int y) const { return data + ptrdiff_t(y - y0) * stride + (x - x0); }
+};
+
+inline ImageView view(Image& image) { return { image.buffer.data(), image.width, 0, 0 }; }
+inline ConstImageView view(const Image& image) { return { image.buffer.data(), image.width, 0, 0 }; }
+
+// Pixels of region only, region in full-frame coordinates
+struct Tile
+{
+    Image image;
+    Rect region = { 0, 0, 0, 0 };
+
+    void resize(Rect r)
+    {
+        region = r;
+        image.resize(r.width(), r.height());
+    }
+    ImageView view() { return { image.buffer.data(), image.width, region.x0, region.y0 }; }
+};
+
+// Exact convolves with the full gaussian kernel, O(kernel) per pixel.
+// Box stacks three box blurs matched to the same standard deviation,
+// O(1) per pixel regardless of kernel size.
+enum class BlurMode
+{
+    Exact,
+    Box
+};
+
+// How far from an output pixel a blur reads
+int blurReach(int kernel, BlurMode mode);
+
+enum class MaskShape
+{
+    Horizontal,
+    Vertical,
+    Circle
+};
+
+// The mask of one composite frame, a wipe at t from 0 to 1, or when
+// file is set an image whose brightness is the mask
+struct WipeMask
+{
+    MaskShape shape;
+    float t;
+    int feathering;
+    std::string file;
+};
+
 // Handles operations that require a memory pool.
 class ImagePipeline
 {
@@ -109,6 +196,14 @@ public:
     Image temp1;
     Image temp2;
     Image temp3;
+    Image regionIn;
+    Image regionOut;
+    PlanarImage planarTemp;
+    HalfImage halfTemp1;
+    HalfImage halfTemp2;
+    ByteImage byteTemp1;
+    ByteImage byteTemp2;
+    ByteImage byteTemp3;
 
     // 1 Image input, non-Image output
     col4f max(const Image& image);
@@ -126,8 +221,16 @@ public:
     void thresholdColor(const Image& in, Image& out, float threshold);
     void adjustHSV(const Image& in, Image& out, col4f_hsv_t hsv);
     void gaussianBlur(const Image& in, Image& out, int kernel);
+    void gaussianBlur(const Image& in, Image& out, int kernel, BlurMode mode);
+    void gaussianBlur(const Image& in, Image& out, int kernel, BlurMode mode, Rect region);
+    // in must cover region plus blurReach, clipped to the width x height frame
+    void gaussianBlur(ConstImageView in, ImageView out, int width, int height, int kernel, BlurMode mode, Rect region);
+    void boxBlur(const Image& in, Image& out, int radius);
+    void stackedBoxBlur(const Image& in, Image& out, const int* radii, int passes);
     void gaussianDeBlur(const Image& in, Image& out, int kernel);
+    void gaussianDeBlur(const Image& in, Image& out, int kernel, float regularization);
     void bloom(const Image& in, Image& out, float threshold, int kernel, float strength);
+    void bloom(const Image& in, Image& out, float threshold, int kernel, float strength, BlurMode mode);
 
     // 2 Image input, 1 Image output
     // Ensure output fits the larger width and larger height from each image
@@ -135,16 +238,68 @@ public:
     void add(const Image& in1, const Image& in2, Image& out);
     void subtract(const Image& in1, const Image& in2, Image& out);
 
-    // Mask output
+    // Mask output. The wipe masks clamp to [0, 1], so the 8-bit
+    // overloads below draw exactly what these do.
     void maskify(const Image& imgIn, Image& maskOut);
     void horizontalMask(Image& maskOut, float t, int feathering, int width, int height);
     void verticalMask(Image& maskOut, float t, int feathering, int width, int height);
     void circleMask(Image& maskOut, float t, int feathering, int width, int height);
     void perlinNoiseMask(Image& maskOut, float frequency, float z, int width, int height);
+    void horizontalMask(Image& maskOut, float t, int feathering, int width, int height, Rect region);
+    void verticalMask(Image& maskOut, float t, int feathering, int width, int height, Rect region);
+    void circleMask(Image& maskOut, float t, int feathering, int width, int height, Rect region);
+    void perlinNoiseMask(Image& maskOut, float frequency, float z, int width, int height, Rect region);
+    void horizontalMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region);
+    void verticalMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region);
+    void circleMask(ImageView maskOut, float t, int feathering, int width, int height, Rect region);
+    void perlinNoiseMask(ImageView maskOut, float frequency, float z, int width, int height, Rect region);
     
     // 2 Image input, 1 Mask input, 1 Image output
     // Not size checked for now
     void composite(const Image& imgIn1, const Image& imgIn2, Image& imgOut, const Image& mask);
+    void composite(ConstImageView imgIn1, ConstImageView imgIn2, ImageView imgOut, ConstImageView mask, Rect region);
+
+    // Runs every op in the chain in one fused pass over in
+    // Output may alias input, or any image the chain reads at the same pixel
+    void apply(const PointChain& chain, const Image& in, Image& out);
+    void apply(const PointChain& chain, const Image& in, Image& out, Rect region);
+    // Images the chain reads are width x height full frames
+    void apply(const PointChain& chain, ConstImageView in, ImageView out, int width, int height, Rect region);
+    // Half storage, each block is widened, run through the chain in
+    // float and narrowed again. Images the chain reads stay col4f.
+    void apply(const PointChain& chain, const HalfImage& in, HalfImage& out);
+    void composite(const HalfImage& imgIn1, const HalfImage& imgIn2, HalfImage& imgOut, const HalfImage& mask);
+    // The float blur and bloom on half storage, math in float between
+    // loads and stores, so values past 1 survive
+    void gaussianBlur(const HalfImage& in, HalfImage& out, int kernel);
+    void bloom(const HalfImage& in, HalfImage& out, float threshold, int kernel, float strength);
+
+    // Planar overloads of the channel-wise ops, see planar-image.cpp
+    void toNegative(const PlanarImage& in, PlanarImage& out);
+    void scaleContrast(const PlanarImage& in, PlanarImage& out, float contrast);
+    void scaleBrightness(const PlanarImage& in, PlanarImage& out, float brightness);
+    void toGreyscale(const PlanarImage& in, PlanarImage& out, col4f weights);
+    void threshold(const PlanarImage& in, PlanarImage& out, float threshold);
+    void thresholdColor(const PlanarImage& in, PlanarImage& out, float threshold);
+    void gaussianBlur(const PlanarImage& in, PlanarImage& out, int kernel);
+    void composite(const PlanarImage& imgIn1, const PlanarImage& imgIn2, PlanarImage& imgOut, const PlanarImage& mask);
+
+    // 8-bit overloads for LDR-only work, see byte-image.cpp
+    void toNegative(const ByteImage& in, ByteImage& out);
+    void colorTint(const ByteImage& in, ByteImage& out, col4f tint);
+    void threshold(const ByteImage& in, ByteImage& out, float threshold);
+    void thresholdColor(const ByteImage& in, ByteImage& out, float threshold);
+    void maskify(const ByteImage& imgIn, ByteImage& maskOut);
+    void horizontalMask(ByteImage& maskOut, float t, int feathering, int width, int height);
+    void verticalMask(ByteImage& maskOut, float t, int feathering, int width, int height);
+    void circleMask(ByteImage& maskOut, float t, int feathering, int width, int height);
+    void composite(const ByteImage& imgIn1, const ByteImage& imgIn2, ByteImage& imgOut, const ByteImage& mask);
+
+    // Read fg and bg, composite fg over bg through mask and write out.
+    // Runs on ByteImages when every file is LDR and falls back to float
+    // otherwise. False when a file can't be read or written, or when
+    // fg, bg and the mask aren't all the same size.
+    bool compositeFiles(const char* fg, const char* bg, const WipeMask& mask, const char* out);
 };
 
 
@@ -5,15 +5,23 @@
 #include <iostream>
 #include <chrono>
 #include "temporal-sampler.h"
+#include "benchmark.h"
+#include "node-graph.h"
+#include "batch-renderer.h"
+#include "frame-source.h"
+#include "frame-writer.h"
 
 void dvdLogoScene()
 {
-    Viewport viewport(1920, 1080);
+    BatchRenderer renderer;
+    FrameWriter writer;
+    std::vector<Viewport> viewports(renderer.workerCount(), Viewport(1920, 1080));
+    Viewport& viewport = viewports[0];
     Image img;
     img.read("input/dvd-logo.png");
+    MipPyramid mips(img);
     vec2 scale;
     float rotation;
-    vec2 translation;
     scale.x = 0.5f;
     scale.y = 0.5f;
     float scaledWidth = scale.x * float(img.width);
@@ -33,8 +41,6 @@ void dvdLogoScene()
     vec2 boundsBottomRight = viewportBottomRight + 3 * imgTopLeft;
 
     rotation = 0.0f;
-    translation.x = 0.0f;
-    translation.y = 0.0f;
 
     col4f clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
     
@@ -51,12 +57,14 @@ void dvdLogoScene()
         boundsTopLeft + (vec2) { 0.0f, 0.0f },
         boundsBottomRight + (vec2) { 100.0f, 0.0f }
     };
-    for (int frame = 1; frame <= 120; frame++)
+    // Keyframes evaluated for the whole range before any frame renders
+    std::vector<Affine2> transforms = viewport.inverseTransforms(img, 1, 120, [&](int frame)
     {
-        int startTime;
-        int endTime;
-        vec2 startPos;
-        vec2 endPos;
+        // Frames outside the keyframes hold the first one
+        int startTime = frames[0];
+        int endTime = frames[1];
+        vec2 startPos = positions[0];
+        vec2 endPos = positions[0];
         for (int i = 0; i + 1 < 9; i++)
         {
             if (frame > frames[i] && frame <= frames[i + 1])
@@ -69,9 +77,13 @@ void dvdLogoScene()
         }
 
         float t = float(frame - startTime) / float(endTime - startTime);
-        translation = linear_interpolation(t, startPos, endPos);
+        return Placement { scale, rotation, linear_interpolation(t, startPos, endPos) };
+    });
+    renderer.render(1, 120, [&](int frame, FrameWorker& worker)
+    {
+        Viewport& viewport = viewports[worker.index];
         viewport.clearColor(clearColor);
-        viewport.drawImage(img, scale, rotation, translation);
+        viewport.drawImage(mips, transforms[frame - 1]);
         std::string suffix = "";
         if (frame < 10)
             suffix = "000";
@@ -81,48 +93,68 @@ void dvdLogoScene()
             suffix = "0";
         suffix += std::to_string(frame) + ".png";
         std::string outputFilename = "output/dvd-logo/dvd-logo" + suffix;
-        viewport.viewport.write(outputFilename.c_str());
-    }
+        writer.write(viewport.viewport, outputFilename);
+    });
+    writer.flush();
+    writer.printStats();
 }
 
 void rotatingImageScene()
 {
-
-    Viewport viewport(1920, 1080);
+    BatchRenderer renderer;
+    FrameWriter writer;
+    std::vector<Viewport> viewports(renderer.workerCount(), Viewport(1920, 1080));
     Image sky;
     sky.read("sky.jpg");
     Image sun;
     sun.read("sun.jpg");
     Image birds;
     birds.read("birds.jpg");
+    // Everything here is drawn minified, the pyramids are shared by every worker
+    MipPyramid skyMips(sky);
+    MipPyramid sunMips(sun);
+    MipPyramid birdsMips(birds);
 
     vec2 skyScale = { 0.5f, 0.5f };
     float skyRotation = 0.0f;
     vec2 skyTranslation = { -1300.0f, -1000.0f };
 
     vec2 sunScale = { 0.5f, 0.5f };
-    float sunRotation = 0.0f;
     vec2 sunTranslation = { 0.0f, 0.0f };
 
     vec2 birdsScale = { 0.3f, 0.3f };
     float birdsRotation = 0.0f;
-    vec2 birdsTranslation = { - 1920.0f / 2.0f, 0.0f };
 
     col4f clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-    
-    for (int frame = 1; frame <= 120; frame++)
+
+    // Placements worked out up front, the sky's once and the others per frame
+    const Viewport& placer = viewports[0];
+    Affine2 skyTransform = placer.inverseTransform(sky, skyScale, skyRotation, skyTranslation);
+    std::vector<Affine2> sunTransforms = placer.inverseTransforms(sun, 1, 120, [&](int frame)
     {
         float t = float(frame) / 120.0f;
-
-        sunRotation = linear_interpolation(t, 0.0f, 360.0f * 5.0f);
-
+        float sunRotation = linear_interpolation(t, 0.0f, 360.0f * 5.0f);
+        return Placement { sunScale, sunRotation, sunTranslation };
+    });
+    std::vector<Affine2> birdsTransforms = placer.inverseTransforms(birds, 1, 120, [&](int frame)
+    {
+        float t = float(frame) / 120.0f;
+        vec2 birdsTranslation;
         birdsTranslation.x = linear_interpolation(t, -1920.0f / 2.0f, 1920.0f / 2.0f);
         birdsTranslation.y = 50.0f * sin(0.2f * birdsTranslation.x);
-
-        viewport.clearColor(clearColor);
-        viewport.drawImage(sky, skyScale, skyRotation, skyTranslation);
-        viewport.drawImage(sun, sunScale, sunRotation, sunTranslation);
-        viewport.drawImage(birds, birdsScale, birdsRotation, birdsTranslation);
+        return Placement { birdsScale, birdsRotation, birdsTranslation };
+    });
+    
+    renderer.render(1, 120, [&](int frame, FrameWorker& worker)
+    {
+        Viewport& viewport = viewports[worker.index];
+
+        // One pass over the frame for the clear and all three images
+        viewport.drawLayers({
+            { nullptr, &skyMips, {}, 0.0f, {}, LayerBlend::Over, &skyTransform },
+            { nullptr, &sunMips, {}, 0.0f, {}, LayerBlend::Over, &sunTransforms[frame - 1] },
+            { nullptr, &birdsMips, {}, 0.0f, {}, LayerBlend::Over, &birdsTransforms[frame - 1] }
+        }, clearColor);
         std::string suffix = "";
         if (frame < 10)
             suffix = "000";
@@ -132,15 +164,20 @@ void rotatingImageScene()
             suffix = "0";
         suffix += std::to_string(frame) + ".png";
         std::string outputFilename = "output/rotating-img/rotating-img" + suffix;
-        viewport.viewport.write(outputFilename.c_str());
-    }
+        writer.write(viewport.viewport, outputFilename);
+    });
+    writer.flush();
+    writer.printStats();
 }
 
 void spinningHeadlineScene()
 {
-    Viewport viewport(1920, 1080);
+    BatchRenderer renderer;
+    FrameWriter writer;
+    std::vector<Viewport> viewports(renderer.workerCount(), Viewport(1920, 1080));
     Image newspaper;
     newspaper.read("spiderman.jpg");
+    MipPyramid newspaperMips(newspaper);
     vec2 scale0 = { 0.0f, 0.0f };
     float rotation0 = 0.0f;
     vec2 translation0 = { 0.0f, 0.0f };
@@ -150,17 +187,22 @@ void spinningHeadlineScene()
     vec2 translation1 = { 0.0f, -540.0f };
 
     col4f clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-    
-    for (int frame = 1; frame <= 120; frame++)
+
+    std::vector<Affine2> transforms = viewports[0].inverseTransforms(newspaper, 1, 120, [&](int frame)
     {
         float t = float(frame) / 120.0f;
-
-        vec2 scale = linear_interpolation(t, scale0, scale1);
-        float rotation = linear_interpolation(t, rotation0, rotation1);
-        vec2 translation = linear_interpolation(t, translation0, translation1);
-
+        return Placement {
+            linear_interpolation(t, scale0, scale1),
+            linear_interpolation(t, rotation0, rotation1),
+            linear_interpolation(t, translation0, translation1)
+        };
+    });
+    
+    renderer.render(1, 120, [&](int frame, FrameWorker& worker)
+    {
+        Viewport& viewport = viewports[worker.index];
         viewport.clearColor(clearColor);
-        viewport.drawImage(newspaper, scale, rotation, translation);
+        viewport.drawImage(newspaperMips, transforms[frame - 1]);
         std::string suffix = "";
         if (frame < 10)
             suffix = "000";
@@ -170,8 +212,10 @@ void spinningHeadlineScene()
             suffix = "0";
         suffix += std::to_string(frame) + ".png";
         std::string outputFilename = "output/spinning/spinning" + suffix;
-        viewport.viewport.write(outputFilename.c_str());
-    }
+        writer.write(viewport.viewport, outputFilename);
+    });
+    writer.flush();
+    writer.printStats();
 }
 
 void tileScene()
@@ -187,20 +231,13 @@ void tileScene()
     output.resize(1920, 1080);
     int tileWidth = 1920 / 8;
     int tileHeight = 1080 / 8;
-    for (int frame = 1; frame <= 120; frame++)
+    FrameSource frames("input/sprite/sprite", "png", 1, 120);
+    FrameWriter writer;
+    int frame;
+    while (frames.next(input, frame))
     {
-        std::string suffix = "";
-        if (frame < 10)
-            suffix = "000";
-        else if (frame < 100)
-            suffix = "00";
-        else if (frame < 1000)
-            suffix = "0";
-        suffix += std::to_string(frame) + ".png";
-        std::string inputFilename = "input/sprite/sprite" + suffix;
-        std::string outputFilename = "output/sprite/sprite" + suffix;
+        std::string outputFilename = fileName("output/sprite/sprite", frame, "png");
 
-        input.read(inputFilename.c_str());
         for (int x = 0; x + 1 < input.width; x++)
         {
             for (int y = 0; y + 1 < input.height; y++)
@@ -238,8 +275,11 @@ void tileScene()
                 }
             }
         }
-        output.write(outputFilename.c_str());
+        writer.write(output, outputFilename);
     }
+    frames.printStats();
+    writer.flush();
+    writer.printStats();
 }
 
 
@@ -256,20 +296,16 @@ void pixelatedScene()
     output.resize(1920, 1080);
     int tileWidth = 32;
     int tileHeight = 32;
-    for (int frame = 1; frame <= 120; frame++)
+    FrameSource frames("input/sprite/sprite", "png", 1, 120);
+    FrameWriter writer;
+    int frame;
+    while (frames.next(input, frame))
     {
-        std::string suffix = "";
-        if (frame < 10)
-            suffix = "000";
-        else if (frame < 100)
-            suffix = "00";
-        else if (frame < 1000)
-            suffix = "0";
-        suffix += std::to_string(frame) + ".png";
-        std::string inputFilename = "input/sprite/sprite" + suffix;
-        std::string outputFilename = "output/pixelated/pixelated" + suffix;
+        std::string outputFilename = fileName("output/pixelated/pixelated", frame, "png");
+        // The tiles stop short of the bottom edge, and the writer hands
+        // back buffers still holding older frames
+        output.clearColor(col4f(0.0f, 0.0f, 0.0f, 1.0f));
 
-        input.read(inputFilename.c_str());
         for (int x = 0; x + 1 < input.width; x++)
         {
             for (int y = 0; y + 1 < input.height; y++)
@@ -320,8 +356,11 @@ void pixelatedScene()
                 }
             }
         }
-        output.write(outputFilename.c_str());
+        writer.write(output, outputFilename);
     }
+    frames.printStats();
+    writer.flush();
+    writer.printStats();
 }
 
 void perlinScene()
@@ -332,8 +371,8 @@ void perlinScene()
     black.clearColor(col4f(0.0f, 0.0f, 0.0f, 1.0f));
     Image white(1920, 1080);
     white.clearColor(col4f(1.0f, 1.0f, 1.0f, 1.0f));
-    Image output(1920, 1080);
     /*
+    Image output(1920, 1080);
     for (int frame = 1; frame <= 120; frame++)
     {
 
@@ -362,29 +401,58 @@ void perlinScene()
     before.read("input/perlin/before.jpg");
     after.read("input/perlin/after.jpg");
 
-    col4f red = col4f(1.0f, 0.1f, 0.0f, 1.0f);
-    Image redImg(1920, 1080);
-    redImg.clearColor(red);
-    for (int frame = 241; frame <= 360; frame++)
+    // Frames 242-360 differ from the old loop on purpose. It reused
+    // before to hold the second wipe's blurred noise mask, so from frame
+    // 242 on the first wipe started from the last frame's mask instead
+    // of before.jpg. The graph reads before.jpg on every frame.
+
+    // One graph per worker, the node caches aren't shared
+    auto buildGraph = [&](NodeGraph& graph)
     {
-        float t = float(frame - 240) / 120.0f;
-        imgPipeline.perlinNoiseMask(perlinMask, 100.0f, float(frame), 1920, 1080);
-        imgPipeline.composite(white, black, output, perlinMask);
-        imgPipeline.threshold(output, output, t);
-        imgPipeline.gaussianBlur(output, output, 51);
-        imgPipeline.maskify(output, perlinMask);
-        imgPipeline.composite(before, after, output, perlinMask);
+        NodeId blackNode = graph.add(std::make_unique<SolidNode>(col4f(0.0f, 0.0f, 0.0f, 1.0f)));
+        NodeId whiteNode = graph.add(std::make_unique<SolidNode>(col4f(1.0f, 1.0f, 1.0f, 1.0f)));
+        NodeId redNode = graph.add(std::make_unique<SolidNode>(col4f(1.0f, 0.1f, 0.0f, 1.0f)));
+        NodeId beforeNode = graph.add(std::make_unique<ImageNode>(before));
+        NodeId afterNode = graph.add(std::make_unique<ImageNode>(after));
+
+        // Thresholded, blurred noise wipes from a to b
+        auto noiseWipe = [&](float frequency, NodeId a, NodeId b)
+        {
+            NodeId noise = graph.add(std::make_unique<PerlinNode>(frequency, Curve([](int frame) { return float(frame); })));
+            NodeId noiseImg = graph.add(std::make_unique<CompositeNode>(), { whiteNode, blackNode, noise });
+            NodeId thresholded = graph.add(std::make_unique<PointNode>([](PointChain& chain, int frame)
+            {
+                chain.threshold(float(frame - 240) / 120.0f);
+            }), { noiseImg });
+            NodeId blurred = graph.add(std::make_unique<BlurNode>(51), { thresholded });
+            NodeId mask = graph.add(std::make_unique<PointNode>([](PointChain& chain, int frame)
+            {
+                chain.maskify();
+            }, false), { blurred });
+            return graph.add(std::make_unique<CompositeNode>(), { a, b, mask });
+        };
+        NodeId wipe = noiseWipe(100.0f, beforeNode, afterNode);
+        return noiseWipe(50.0f, wipe, redNode);
+    };
 
-        imgPipeline.perlinNoiseMask(perlinMask, 50.0f, float(frame), 1920, 1080);
-        imgPipeline.composite(white, black, before, perlinMask);
-        imgPipeline.threshold(before, before, t);
-        imgPipeline.gaussianBlur(before, before, 51);
-        imgPipeline.maskify(before, perlinMask);
-        imgPipeline.composite(output, redImg, output, perlinMask);
+    BatchRenderer renderer;
+    std::vector<std::unique_ptr<NodeGraph>> graphs;
+    NodeId output = 0;
+    for (int i = 0; i < renderer.workerCount(); i++)
+    {
+        graphs.push_back(std::make_unique<NodeGraph>(1920, 1080));
+        output = buildGraph(*graphs.back());
+    }
 
+    FrameWriter writer;
+    renderer.render(241, 360, [&](int frame, FrameWorker& worker)
+    {
+        graphs[worker.index]->render(output, frame, worker.output, { 0, 0, 1920, 1080 });
         std::string outputFilename = fileName("output/perlin/perlin", frame, "png");
-        output.write(outputFilename.c_str());
-    }
+        writer.write(worker.output, outputFilename);
+    });
+    writer.flush();
+    writer.printStats();
 //    */
 }
 
@@ -393,16 +461,41 @@ void temporalSamplerScene()
 {
     TemporalSampler tsamp;
     int frames = 243;
-    tsamp.loadFrames("input/temporal/temporal", frames, "png");
+    // Pack the clip into one mapped container the first time, after
+    // that the frames page in from it as processFrame reads them
+    FrameSequence packed;
+    if (!packed.open("input/temporal/temporal.cfs")
+        && !buildSequence("input/temporal/temporal.cfs", "input/temporal/temporal", "png", 1, frames))
+    {
+        std::cerr << "ERROR: Failed to pack input/temporal/temporal.cfs" << std::endl;
+        return;
+    }
+    packed.close();
+    if (!tsamp.mapFrames("input/temporal/temporal.cfs", "output/temporal/temporal.cfs"))
+    {
+        return;
+    }
     ImagePipeline imgPipeline;
     Image mask;
     
     for (int i = 0; i < tsamp.size(); i++)
     {
-        imgPipeline.perlinNoiseMask(mask, 50.0f, float(i), tsamp.inputFrames[0].width, tsamp.inputFrames[0].height);
+        imgPipeline.perlinNoiseMask(mask, 50.0f, float(i), tsamp.width, tsamp.height);
         tsamp.processFrame(i, -50, 0, mask);
     }
-    tsamp.writeFrames("output/temporal/temporal", frames, "png");
+    tsamp.writeFrames("output/temporal/temporal", "png");
+}
+
+// Same effect, holding only the frames the offset window spans
+void temporalStreamScene()
+{
+    TemporalSampler tsamp;
+    ImagePipeline imgPipeline;
+    tsamp.streamFrames("input/temporal/temporal", 243, "png", "output/temporal/temporal", "png", -50, 0,
+        [&](int frame, Image& mask)
+    {
+        imgPipeline.perlinNoiseMask(mask, 50.0f, float(frame), tsamp.width, tsamp.height);
+    });
 }
 
 
@@ -416,6 +509,21 @@ int main()
     //pixelatedScene();
     //perlinScene();
     temporalSamplerScene();
+    //temporalStreamScene();
+    //blurBenchmark();
+    //blurModeBenchmark();
+    //deblurBenchmark();
+    //planarBenchmark();
+    //pixelKernelBenchmark();
+    //pointChainBenchmark();
+    //tileBenchmark();
+    //threadScalingBenchmark();
+    //frameFileBenchmark();
+    //temporalBenchmark();
+    //halfBenchmark();
+    //byteBenchmark();
+    //mipBenchmark();
+    //layerBenchmark();
 
     /*
     ImagePipeline imgPipeline;
@@ -453,10 +561,6 @@ int main()
     /*
     int vidFrames = 120;
     ImagePipeline imgPipeline;
-    Image imgIn1;
-    Image imgIn2;
-    Image imgOut;
-    Image mask;
     int maskType = 0;
     std::string readFilename1;
     std::string readFilename2;
@@ -500,34 +604,13 @@ int main()
         std::string readFile3 = "input/" + readFilename3 + suffix;
         std::string writeFile = "output/" + writeFilename + suffix;
 
-        switch (maskType)
+        // LDR inputs never leave 8 bits, see ImagePipeline::compositeFiles
+        WipeMask mask = { MaskShape(std::min(maskType, 2)), transition, 30 };
+        if (maskType == 3)
         {
-            case 0:
-                imgIn1.read(readFile1.c_str());
-                imgIn2.read(readFile2.c_str());
-                imgPipeline.horizontalMask(mask, transition, 30, imgIn1.width, imgIn1.height);
-                break;
-            case 1:
-                imgIn1.read(readFile1.c_str());
-                imgIn2.read(readFile2.c_str());
-                imgPipeline.verticalMask(mask, transition, 30, imgIn1.width, imgIn1.height);
-                break;
-            case 2:
-                imgIn1.read(readFile1.c_str());
-                imgIn2.read(readFile2.c_str());
-                imgPipeline.circleMask(mask, transition, 30, imgIn1.width, imgIn1.height);
-                break;
-            case 3:
-                imgIn1.read(readFile1.c_str());
-                imgIn2.read(readFile2.c_str());
-                mask.read(readFile3.c_str()); // Only handle the part that fits over imgIn for now.
-                imgPipeline.maskify(mask, mask);
-                break;
-            default:
-                break;
+            mask.file = readFile3;
         }
-        imgPipeline.composite(imgIn1, imgIn2, imgOut, mask);
-        imgOut.write(writeFile.c_str());
+        imgPipeline.compositeFiles(readFile1.c_str(), readFile2.c_str(), mask, writeFile.c_str());
         auto end = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         timeSpentNotPrinting += duration;
@@ -9,6 +9,7 @@
 #ifndef MATH_H
 #define MATH_H
 
+#include <algorithm>
 #include <cmath>
 #include <numbers>
 
@@ -41,24 +42,92 @@ inline vec2 vecScale(const vec2& scale, const vec2& a)
     return { scale.x * a.x, scale.y * a.y };
 }
 
-/* Potential optimization:
- * Possibly cache sin_theta and cos_theta for long streams of this operation
- */
-inline vec2 vecRotate(const float& radians, const vec2& a)
+// Rotation with sin and cos already taken, for many vectors at one angle
+inline vec2 vecRotate(const float& sin_theta, const float& cos_theta, const vec2& a)
 {
-    float sin_theta = sin(radians);
-    float cos_theta = cos(radians);
     return {
         cos_theta * a.x - sin_theta * a.y,
         sin_theta * a.x + cos_theta * a.y
     };
 }
 
+inline vec2 vecRotate(const float& radians, const vec2& a)
+{
+    return vecRotate(sin(radians), cos(radians), a);
+}
+
 inline vec2 vecTranslate(const vec2& translation, const vec2& a)
 {
     return { translation.x + a.x, translation.y + a.y };
 }
 
+/************************************************************************
+* 2x3 affine transform, p' = (a * x + c * y + tx, b * x + d * y + ty).
+* Composes like matrices, (m * n)(p) = m(n(p)), so a chain of scales,
+* rotations and translations collapses into one transform, with sin and
+* cos taken once when it's built instead of for every point.
+************************************************************************/
+struct Affine2
+{
+    float a;
+    float b;
+    float c;
+    float d;
+    float tx;
+    float ty;
+};
+
+inline vec2 transformPoint(const Affine2& m, const vec2& p)
+{
+    return { m.a * p.x + m.c * p.y + m.tx, m.b * p.x + m.d * p.y + m.ty };
+}
+
+inline Affine2 operator*(const Affine2& m, const Affine2& n)
+{
+    vec2 origin = transformPoint(m, { n.tx, n.ty });
+    return {
+        m.a * n.a + m.c * n.b, m.b * n.a + m.d * n.b,
+        m.a * n.c + m.c * n.d, m.b * n.c + m.d * n.d,
+        origin.x, origin.y
+    };
+}
+
+inline float determinant(const Affine2& m)
+{
+    return m.a * m.d - m.b * m.c;
+}
+
+// Only meaningful when the determinant isn't 0
+inline Affine2 inverse(const Affine2& m)
+{
+    float invDet = 1.0f / determinant(m);
+    float a = m.d * invDet;
+    float b = -m.b * invDet;
+    float c = -m.c * invDet;
+    float d = m.a * invDet;
+    return { a, b, c, d, -(a * m.tx + c * m.ty), -(b * m.tx + d * m.ty) };
+}
+
+inline Affine2 affineScale(const vec2& scale)
+{
+    return { scale.x, 0.0f, 0.0f, scale.y, 0.0f, 0.0f };
+}
+
+inline Affine2 affineRotate(const float& sin_theta, const float& cos_theta)
+{
+    return { cos_theta, sin_theta, -sin_theta, cos_theta, 0.0f, 0.0f };
+}
+
+inline Affine2 affineRotate(const float& radians)
+{
+    return affineRotate(sin(radians), cos(radians));
+}
+
+inline Affine2 affineTranslate(const vec2& translation)
+{
+    return { 1.0f, 0.0f, 0.0f, 1.0f, translation.x, translation.y };
+}
+
 inline vec3 operator+(const vec3& a, const vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
 inline vec3 operator-(const vec3& a, const vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
 inline vec3 operator*(const float& a, const vec3& b) { return { a * b.x, a * b.y, a * b.z }; }
@@ -69,6 +138,45 @@ inline float length(const vec3& a) { return sqrt(length2(a)); };
 inline float distance(const vec3& a, const vec3& b) { return length(a - b); };
 inline vec3 normalized(const vec3& a) { return (1.0f / length(a)) * a; };
 
+/************************************************************************
+* Integer pixel rectangle covering [x0, x1) x [y0, y1)
+************************************************************************/
+struct Rect
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+    bool contains(const Rect& r) const
+    {
+        return r.empty() || (r.x0 >= x0 && r.y0 >= y0 && r.x1 <= x1 && r.y1 <= y1);
+    }
+};
+
+inline Rect intersect(const Rect& a, const Rect& b)
+{
+    return { std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1) };
+}
+
+// Smallest rect covering both, ignoring empty rects
+inline Rect unite(const Rect& a, const Rect& b)
+{
+    if (a.empty())
+        return b;
+    if (b.empty())
+        return a;
+    return { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+}
+
+inline Rect expand(const Rect& a, int amount)
+{
+    return { a.x0 - amount, a.y0 - amount, a.x1 + amount, a.y1 + amount };
+}
+
 /************************************************************************
 * Branchless clamp for ints and floats
 ************************************************************************/
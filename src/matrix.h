@@ -6,6 +6,7 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <vector>
 #include "image.h"
 
 class SquareMatrix
@@ -128,4 +129,150 @@ class SquareMatrix
             
 };
 
+/************************************************************************
+* Square matrix that is zero outside |row - col| <= band, stored by row
+* with only the 2 * band + 1 diagonals kept. Row i holds columns
+* [i - band, i + band], so a side x side matrix costs side * (2 * band + 1)
+* floats instead of side * side.
+*
+* Solves take several right hand sides at once: element k of the system
+* lives at data + k * stride and is count floats wide. A row of pixels is
+* (stride 4, count 4), a whole image solved down its columns is
+* (stride 4 * width, count 4 * width).
+************************************************************************/
+class BandedMatrix
+{
+    public:
+        std::vector<float> mat;
+        int side;
+        int band;
+        int stride;
+        BandedMatrix(int side, int band) : mat(side * (2 * band + 1), 0.0f), side(side), band(band), stride(2 * band + 1) {}
+        inline float& operator()(size_t rowIndex, size_t colIndex) { return mat[rowIndex * stride + band + colIndex - rowIndex]; }
+        inline const float& operator()(size_t rowIndex, size_t colIndex) const { return mat[rowIndex * stride + band + colIndex - rowIndex]; }
+        inline int firstCol(int row) const { return std::max(0, row - band); }
+        inline int lastCol(int row) const { return std::min(side - 1, row + band); }
+
+        // Tikhonov normal matrix, (A^T)A + lambda * I. The band doubles.
+        BandedMatrix normalProduct(float lambda) const
+        {
+            BandedMatrix normal(side, 2 * band);
+            for (int k = 0; k < side; k++)
+            {
+                for (int i = firstCol(k); i <= lastCol(k); i++)
+                {
+                    for (int j = firstCol(k); j <= lastCol(k); j++)
+                    {
+                        normal(i, j) += (*this)(k, i) * (*this)(k, j);
+                    }
+                }
+            }
+            for (int i = 0; i < side; i++)
+            {
+                normal(i, i) += lambda;
+            }
+            return normal;
+        }
+
+        // out = (A^T)in, in and out must not overlap
+        void transposeMultiply(const float* in, float* out, int count, size_t dataStride) const
+        {
+            for (int i = 0; i < side; i++)
+            {
+                float* o = out + i * dataStride;
+                for (int c = 0; c < count; c++)
+                {
+                    o[c] = 0.0f;
+                }
+                // A(k, i) is nonzero for the rows k within band of i
+                for (int k = firstCol(i); k <= lastCol(i); k++)
+                {
+                    const float weight = (*this)(k, i);
+                    const float* x = in + k * dataStride;
+                    for (int c = 0; c < count; c++)
+                    {
+                        o[c] += weight * x[c];
+                    }
+                }
+            }
+        }
+
+        /*
+         * In place banded Cholesky, A = L(L^T), for symmetric positive definite A.
+         * L is left in the lower half of the band. Accumulates in double since
+         * blur matrices are close to singular. O(side * band^2).
+         */
+        bool choleskyFactor()
+        {
+            for (int j = 0; j < side; j++)
+            {
+                double diagonal = (*this)(j, j);
+                for (int k = firstCol(j); k < j; k++)
+                {
+                    diagonal -= double((*this)(j, k)) * (*this)(j, k);
+                }
+                if (diagonal <= 1e-12)
+                {
+                    std::cerr << "Error: Banded matrix is not positive definite." << std::endl;
+                    return false;
+                }
+                double root = std::sqrt(diagonal);
+                (*this)(j, j) = float(root);
+                for (int i = j + 1; i <= lastCol(j); i++)
+                {
+                    double value = (*this)(i, j);
+                    for (int k = firstCol(i); k < j; k++)
+                    {
+                        value -= double((*this)(i, k)) * (*this)(j, k);
+                    }
+                    (*this)(i, j) = float(value / root);
+                }
+            }
+            return true;
+        }
+
+        // Solve L(L^T)x = b in place, after choleskyFactor()
+        void choleskySolve(float* data, int count, size_t dataStride) const
+        {
+            // Forward substitution, Ly = b
+            for (int i = 0; i < side; i++)
+            {
+                float* x = data + i * dataStride;
+                for (int k = firstCol(i); k < i; k++)
+                {
+                    const float weight = (*this)(i, k);
+                    const float* y = data + k * dataStride;
+                    for (int c = 0; c < count; c++)
+                    {
+                        x[c] -= weight * y[c];
+                    }
+                }
+                const float inverse = 1.0f / (*this)(i, i);
+                for (int c = 0; c < count; c++)
+                {
+                    x[c] *= inverse;
+                }
+            }
+            // Back substitution, (L^T)x = y
+            for (int i = side - 1; i >= 0; i--)
+            {
+                float* x = data + i * dataStride;
+                for (int k = i + 1; k <= lastCol(i); k++)
+                {
+                    const float weight = (*this)(k, i);
+                    const float* y = data + k * dataStride;
+                    for (int c = 0; c < count; c++)
+                    {
+                        x[c] -= weight * y[c];
+                    }
+                }
+                const float inverse = 1.0f / (*this)(i, i);
+                for (int c = 0; c < count; c++)
+                {
+                    x[c] *= inverse;
+                }
+            }
+        }
+};
+
 #endif
@@ -0,0 +1,105 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: mip-pyramid.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "mip-pyramid.h"
+#include "pixel-kernels.h"
+#include "thread-pool.h"
+
+void MipPyramid::build(const Image& image)
+{
+    base = &image;
+    levels.clear();
+    isOpaque = std::all_of(image.buffer.begin(), image.buffer.end(), [](const col4f& pixel) { return pixel.a >= 1.0f; });
+    for (int w = image.width, h = image.height; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        levels.emplace_back();
+    }
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const Image& in = level(int(i));
+        Image& out = levels[i];
+        out.resize(std::max(1, in.width / 2), std::max(1, in.height / 2));
+        // Odd sizes drop their last row or column, 1 wide sides repeat
+        int stepX = std::min(1, in.width - 1);
+        int stepY = std::min(1, in.height - 1);
+        threadPool().parallelFor(out.height, 1, [&](int y0, int y1)
+        {
+            for (int y = y0; y < y1; y++)
+            {
+                const col4f* top = &in(0, 2 * y);
+                const col4f* bottom = top + ptrdiff_t(stepY) * in.width;
+                for (int x = 0; x < out.width; x++)
+                {
+                    int left = 2 * x;
+                    int right = left + stepX;
+                    // Spelled out, col4f's operators carry alpha rather than average it
+                    const col4f& a = top[left];
+                    const col4f& b = top[right];
+                    const col4f& c = bottom[left];
+                    const col4f& d = bottom[right];
+                    out(x, y) = col4f(0.25f * (a.r + b.r + c.r + d.r), 0.25f * (a.g + b.g + c.g + d.g),
+                                      0.25f * (a.b + b.b + c.b + d.b), 0.25f * (a.a + b.a + c.a + d.a));
+                }
+            }
+        });
+    }
+}
+
+/*
+ * Pixel i of a level is centered at i like level 0, so a level 0
+ * coordinate maps to (u + 0.5) * scale - 0.5 on a level scale times
+ * the size. The coarse level's samples go through scratch and are
+ * blended into the fine level's with a constant weight.
+ */
+void trilinearSample(const MipPyramid& mips, int fine, float t, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    const Image& base = mips.level(0);
+    float maxU = float(base.width - 1);
+    float maxV = float(base.height - 1);
+    auto covered = [&](int i)
+    {
+        float x = std::fma(float(i), du, u);
+        float y = std::fma(float(i), dv, v);
+        return x > -1.0f && x < maxU && y > -1.0f && y < maxV;
+    };
+    // Along a line the covered samples are one run, trim to it
+    int first = begin;
+    int last = end;
+    while (first < last && !covered(first))
+    {
+        first++;
+    }
+    while (last > first && !covered(last - 1))
+    {
+        last--;
+    }
+    if (first == last)
+    {
+        return;
+    }
+    out += first - begin;
+    int count = last - first;
+
+    const PixelKernels& kernels = pixelKernels();
+    auto sampleLevel = [&](int index, col4f* samples)
+    {
+        const Image& level = mips.level(index);
+        float scaleX = float(level.width) / float(base.width);
+        float scaleY = float(level.height) / float(base.height);
+        kernels.clampedAffineSample(level.buffer.data(), level.width, level.height,
+                                    (u + 0.5f) * scaleX - 0.5f, (v + 0.5f) * scaleY - 0.5f,
+                                    du * scaleX, dv * scaleY, samples, first, last);
+    };
+    thread_local std::vector<col4f> coarse;
+    thread_local std::vector<float> weights;
+    coarse.resize(count);
+    weights.assign(count, t);
+    sampleLevel(fine, out);
+    sampleLevel(std::min(fine + 1, mips.levelCount() - 1), coarse.data());
+    kernels.blend(out, coarse.data(), weights.data(), out, count);
+}
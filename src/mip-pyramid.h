@@ -0,0 +1,49 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: mip-pyramid.h
+ *
+ * An image and its successive 2x2 box-filtered halvings down to 1x1,
+ * for drawing it minified. Sampling between two levels picked by the
+ * on-screen footprint reads each output pixel's worth of source from
+ * a level where it is about one texel, so it neither aliases nor
+ * scatters reads across a large image. Building costs a third of the
+ * image again, so build one per source and reuse it every frame.
+************************************************************************/
+
+#ifndef MIP_PYRAMID_H
+#define MIP_PYRAMID_H
+
+#include <vector>
+
+#include "color.h"
+#include "image.h"
+
+class MipPyramid
+{
+public:
+    MipPyramid() : base(nullptr), isOpaque(false) {}
+    explicit MipPyramid(const Image& image) { build(image); }
+
+    // image is level 0 and is referenced, not copied, so it must outlive
+    // the pyramid and be rebuilt from if its pixels change
+    void build(const Image& image);
+
+    int levelCount() const { return base ? 1 + int(levels.size()) : 0; }
+    const Image& level(int i) const { return i == 0 ? *base : levels[i - 1]; }
+    // Every pixel has alpha 1, so drawing it over anything hides it
+    bool opaque() const { return isOpaque; }
+
+private:
+    const Image* base;
+    bool isOpaque;
+    std::vector<Image> levels; // Level 1 and down
+};
+
+// Samples at level 0 coordinates (u + i * du, v + i * dv) for i in
+// [begin, end) into out[i - begin], blending bilinear samples of levels
+// fine and fine + 1 by t. Which samples are written is decided on level
+// 0, the same test as PixelKernels::affineSample, so edges don't move
+// with the level. Coarser levels clamp at their edges.
+void trilinearSample(const MipPyramid& mips, int fine, float t, float u, float v, float du, float dv, col4f* out, int begin, int end);
+
+#endif
@@ -0,0 +1,294 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: node-graph.cpp
+ *
+ *******************************************/
+
+#include <iostream>
+#include "node-graph.h"
+
+void ImageNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+}
+
+void SequenceNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    if (loadedFrame != frame)
+    {
+        std::string name = fileName(stem, frame + frameOffset, extension);
+        loadedFrame = -1;
+        if (!frameImage.read(name.c_str()))
+        {
+            failed = true;
+            return;
+        }
+        if (frameImage.width != width || frameImage.height != height)
+        {
+            std::cerr << "ERROR: " << name << " is " << frameImage.width << "x" << frameImage.height
+                      << ", the graph is " << width << "x" << height << std::endl;
+            failed = true;
+            return;
+        }
+        loadedFrame = frame;
+    }
+    for (int y = region.y0; y < region.y1; y++)
+    {
+        std::copy(&frameImage(region.x0, y), &frameImage(region.x0, y) + region.width(), out.at(region.x0, y));
+    }
+}
+
+void SolidNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    for (int y = region.y0; y < region.y1; y++)
+    {
+        std::fill(out.at(region.x0, y), out.at(region.x1, y), color);
+    }
+}
+
+void MaskNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    switch (shape)
+    {
+        case MaskShape::Horizontal:
+            pipeline.horizontalMask(out, t(frame), feathering, width, height, region);
+            break;
+        case MaskShape::Vertical:
+            pipeline.verticalMask(out, t(frame), feathering, width, height, region);
+            break;
+        case MaskShape::Circle:
+            pipeline.circleMask(out, t(frame), feathering, width, height, region);
+            break;
+    }
+}
+
+void PerlinNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    pipeline.perlinNoiseMask(out, frequency(frame), z(frame), width, height, region);
+}
+
+void PointNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    chain.clear();
+    build(chain, frame);
+    pipeline.apply(chain, in[0], out, width, height, region);
+}
+
+void BlurNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    pipeline.gaussianBlur(in[0], out, width, height, kernel, mode, region);
+}
+
+void CompositeNode::process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region)
+{
+    pipeline.composite(in[0], in[1], out, in[2], region);
+}
+
+NodeId NodeGraph::add(std::unique_ptr<Node> node, std::vector<NodeId> inputs)
+{
+    node->inputs = inputs;
+    node->width = width;
+    node->height = height;
+    nodes.push_back(std::move(node));
+    return NodeId(nodes.size() - 1);
+}
+
+// Post-order, so every node lands after its inputs
+void NodeGraph::visit(NodeId id)
+{
+    if (visited[id])
+    {
+        return;
+    }
+    visited[id] = true;
+    for (NodeId input : nodes[id]->inputs)
+    {
+        visit(input);
+    }
+    order.push_back(id);
+}
+
+const Image& NodeGraph::evaluate(NodeId id, int frame)
+{
+    return evaluate(id, frame, { 0, 0, width, height });
+}
+
+// Fill order with the nodes id depends on and needed with the region
+// of each that region of id reads
+void NodeGraph::propagate(NodeId id, Rect region)
+{
+    Rect bounds = { 0, 0, width, height };
+    order.clear();
+    visited.assign(nodes.size(), false);
+    needed.assign(nodes.size(), { 0, 0, 0, 0 });
+    visit(id);
+
+    needed[id] = intersect(region, bounds);
+    for (int i = int(order.size()) - 1; i >= 0; i--)
+    {
+        Node& node = *nodes[order[i]];
+        if (needed[order[i]].empty())
+        {
+            continue;
+        }
+        for (int j = 0; j < int(node.inputs.size()); j++)
+        {
+            Rect inputNeed = intersect(node.inputRegion(j, needed[order[i]]), bounds);
+            needed[node.inputs[j]] = unite(needed[node.inputs[j]], inputNeed);
+        }
+    }
+}
+
+// The cache after region is added to valid. Only a rectangle is
+// tracked, so when the two don't join into one the larger is kept.
+static Rect grownRegion(Rect valid, Rect region)
+{
+    auto area = [](Rect r) { return r.empty() ? 0L : long(r.width()) * long(r.height()); };
+    Rect both = unite(valid, region);
+    if (area(both) == area(valid) + area(region) - area(intersect(valid, region)))
+    {
+        return both;
+    }
+    return area(valid) > area(region) ? valid : region;
+}
+
+/************************************************************************
+* Pull the region of node id for a frame.
+*
+* Push the requested region back through the upstream nodes, so each
+* node learns the union of what its consumers read, then run them in
+* dependency order. A node is skipped if its parameters, frame and input
+* versions match what its cached output was made from and the cache
+* already covers the region asked of it.
+************************************************************************/
+const Image& NodeGraph::evaluate(NodeId id, int frame, Rect region)
+{
+    propagate(id, region);
+
+    processed = 0;
+    failed = false;
+    std::vector<int> versions;
+    for (NodeId nodeId : order)
+    {
+        Node& node = *nodes[nodeId];
+        if (needed[nodeId].empty())
+        {
+            continue;
+        }
+        views.clear();
+        versions.clear();
+        for (NodeId input : node.inputs)
+        {
+            views.push_back(view(nodes[input]->result()));
+            versions.push_back(nodes[input]->version);
+        }
+
+        bool fresh = !node.dirty
+            && (!node.animated() || node.validFrame == frame)
+            && node.inputVersions == versions;
+        if (fresh && node.validRegion.contains(needed[nodeId]))
+        {
+            continue;
+        }
+        if (!fresh)
+        {
+            // Pixels outside the new region are stale, so consumers
+            // have to recompute too.
+            node.version++;
+            node.dirty = false;
+            node.validFrame = frame;
+            node.inputVersions = versions;
+        }
+        // A fresh node only grows its cache, pixels it already holds
+        // don't change and consumers' caches stay valid.
+        if (!node.external())
+        {
+            node.output.resize(width, height);
+            node.failed = false;
+            node.process(pipeline, views, view(node.output), frame, needed[nodeId]);
+            processed++;
+            if (node.failed)
+            {
+                // Nothing downstream runs, and the node retries next time
+                node.dirty = true;
+                node.validRegion = { 0, 0, 0, 0 };
+                failed = true;
+                return nodes[id]->result();
+            }
+        }
+        if (node.external())
+        {
+            node.validRegion = { 0, 0, width, height };
+        }
+        else
+        {
+            node.validRegion = fresh ? grownRegion(node.validRegion, needed[nodeId]) : needed[nodeId];
+        }
+    }
+    return nodes[id]->result();
+}
+
+/************************************************************************
+* Render region of node id one tile at a time.
+*
+* Each tile pulls its own regions through the graph like evaluate()
+* does, but every node writes into a Tile covering just what the tile
+* needs of it, and the buffers are reused from tile to tile. Nodes
+* upstream of a blur see the tile widened by the blur's reach, so
+* tiles overlap there and some pixels are computed twice.
+************************************************************************/
+void NodeGraph::render(NodeId id, int frame, Image& out, Rect region, int tileSize)
+{
+    out.resize(width, height);
+    failed = false;
+    region = intersect(region, { 0, 0, width, height });
+    if (nodes[id]->external())
+    {
+        pipeline.apply(PointChain(), view(nodes[id]->result()), view(out), width, height, region);
+        return;
+    }
+    tiles.resize(nodes.size());
+    processed = 0;
+    std::vector<ConstImageView> results(nodes.size(), view(out));
+    for (int ty = region.y0; ty < region.y1; ty += tileSize)
+    {
+        for (int tx = region.x0; tx < region.x1; tx += tileSize)
+        {
+            Rect tile = intersect({ tx, ty, tx + tileSize, ty + tileSize }, region);
+            propagate(id, tile);
+            for (NodeId nodeId : order)
+            {
+                Node& node = *nodes[nodeId];
+                if (needed[nodeId].empty())
+                {
+                    continue;
+                }
+                if (node.external())
+                {
+                    results[nodeId] = view(node.result());
+                    continue;
+                }
+                views.clear();
+                for (NodeId input : node.inputs)
+                {
+                    views.push_back(results[input]);
+                }
+                // The last node writes straight into out
+                ImageView target = view(out);
+                if (nodeId != id)
+                {
+                    tiles[nodeId].resize(needed[nodeId]);
+                    target = tiles[nodeId].view();
+                }
+                node.failed = false;
+                node.process(pipeline, views, target, frame, needed[nodeId]);
+                processed++;
+                if (node.failed)
+                {
+                    failed = true;
+                    return;
+                }
+                results[nodeId] = target;
+            }
+        }
+    }
+}
@@ -0,0 +1,232 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: node-graph.h
+ *
+ * A lazy, pull-based node graph over ImagePipeline. Inputs, masks,
+ * filters and composites are nodes with parameters, wired together by
+ * id. Evaluating a node for a frame and region only runs the upstream
+ * nodes that region depends on, and only the parts of them it reads.
+ * Each node keeps its last output, so nodes whose parameters, frame
+ * and inputs haven't changed are skipped entirely.
+ *
+ * render() instead walks the result a tile at a time, keeping only
+ * tile-sized intermediates so the whole chain for a tile stays in L2.
+************************************************************************/
+
+#ifndef NODE_GRAPH_H
+#define NODE_GRAPH_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "math.h"
+#include "color.h"
+#include "image.h"
+
+using NodeId = int;
+
+// Edge length of the tiles render() uses by default. A 256x256 tile
+// of col4f is 1MB, so a node's input and output tiles fit a 2MB L2.
+const int TILE_SIZE = 256;
+
+/************************************************************************
+* A node parameter, either a constant or a function of the frame number.
+************************************************************************/
+struct Curve
+{
+    std::function<float(int)> function;
+    float value;
+
+    Curve(float value = 0.0f) : value(value) {}
+    Curve(std::function<float(int)> function) : function(function), value(0.0f) {}
+
+    bool animated() const { return bool(function); }
+    float operator()(int frame) const { return function ? function(frame) : value; }
+};
+
+/************************************************************************
+* Base node. process() fills region of out for a frame. in holds one
+* view per input, each covering what inputRegion() asked of it. out and
+* the input views may be whole frames or tiles, so nodes only index
+* them through ImageView.
+************************************************************************/
+class Node
+{
+public:
+    std::vector<NodeId> inputs;
+    Image output;
+    int width = 0;
+    int height = 0;
+
+    // Cache state, maintained by NodeGraph
+    Rect validRegion = { 0, 0, 0, 0 };
+    int validFrame = 0;
+    int version = 0; // Bumped whenever output changes
+    bool dirty = true;
+    std::vector<int> inputVersions;
+    bool failed = false; // Set by process() when it couldn't produce its output
+
+    virtual ~Node() {}
+
+    // Whether output depends on the frame number
+    virtual bool animated() const { return false; }
+    // Whether result() is a whole frame that never needs processing
+    virtual bool external() const { return false; }
+    // Region of input i read when producing region of this node
+    virtual Rect inputRegion(int input, Rect region) const { return region; }
+    virtual void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) = 0;
+    // The image downstream nodes read
+    virtual const Image& result() const { return output; }
+};
+
+// An image owned outside the graph. Call NodeGraph::invalidate after
+// changing it.
+class ImageNode : public Node
+{
+public:
+    const Image& image;
+
+    ImageNode(const Image& image) : image(image) {}
+
+    bool external() const override { return true; }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+    const Image& result() const override { return image; }
+};
+
+// Numbered frames on disk, stem0001.ext and so on, offset from the
+// graph frame by frameOffset.
+class SequenceNode : public Node
+{
+public:
+    std::string stem;
+    std::string extension;
+    int frameOffset;
+    Image frameImage;
+    int loadedFrame = -1;
+
+    SequenceNode(std::string stem, std::string extension, int frameOffset = 0)
+        : stem(stem), extension(extension), frameOffset(frameOffset) {}
+
+    bool animated() const override { return true; }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+class SolidNode : public Node
+{
+public:
+    col4f color;
+
+    SolidNode(col4f color) : color(color) {}
+
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+// A wipe mask, t runs the transition from 0 to 1
+class MaskNode : public Node
+{
+public:
+    MaskShape shape;
+    Curve t;
+    int feathering;
+
+    MaskNode(MaskShape shape, Curve t, int feathering) : shape(shape), t(t), feathering(feathering) {}
+
+    bool animated() const override { return t.animated(); }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+class PerlinNode : public Node
+{
+public:
+    Curve frequency;
+    Curve z;
+
+    PerlinNode(Curve frequency, Curve z) : frequency(frequency), z(z) {}
+
+    bool animated() const override { return frequency.animated() || z.animated(); }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+/************************************************************************
+* Runs a PointChain over its one input. build() fills the chain for a
+* frame. Ops that read other images (composite, compositeMasked) don't
+* make those images inputs of the node, use CompositeNode for those.
+************************************************************************/
+class PointNode : public Node
+{
+public:
+    std::function<void(PointChain&, int)> build;
+    bool isAnimated;
+    PointChain chain;
+
+    PointNode(std::function<void(PointChain&, int)> build, bool animated = true)
+        : build(build), isAnimated(animated) {}
+
+    bool animated() const override { return isAnimated; }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+class BlurNode : public Node
+{
+public:
+    int kernel;
+    BlurMode mode;
+
+    BlurNode(int kernel, BlurMode mode = BlurMode::Exact) : kernel(kernel), mode(mode) {}
+
+    Rect inputRegion(int input, Rect region) const override { return expand(region, blurReach(kernel, mode)); }
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+// Inputs are { fg, bg, mask }, fg over bg by the mask's alpha
+class CompositeNode : public Node
+{
+public:
+    void process(ImagePipeline& pipeline, const std::vector<ConstImageView>& in, ImageView out, int frame, Rect region) override;
+};
+
+/************************************************************************
+* Owns the nodes and one ImagePipeline they share. All nodes produce
+* width x height images.
+************************************************************************/
+class NodeGraph
+{
+public:
+    std::vector<std::unique_ptr<Node>> nodes;
+    ImagePipeline pipeline;
+    int width;
+    int height;
+    int processed = 0; // process() calls by the last evaluate() or render()
+    bool failed = false; // The last evaluate() or render() stopped at a failed node
+
+    NodeGraph(int width, int height) : width(width), height(height) {}
+
+    NodeId add(std::unique_ptr<Node> node, std::vector<NodeId> inputs = {});
+
+    template <typename T>
+    T& get(NodeId id) { return static_cast<T&>(*nodes[id]); }
+
+    // Mark a node's parameters as changed, its dependents follow
+    void invalidate(NodeId id) { nodes[id]->dirty = true; }
+
+    const Image& evaluate(NodeId id, int frame);
+    // Only region of the result is valid, and none of it when failed is set
+    const Image& evaluate(NodeId id, int frame, Rect region);
+    // Tile by tile into out, only region is written. Doesn't read or
+    // update the node caches evaluate() keeps.
+    void render(NodeId id, int frame, Image& out, Rect region, int tileSize = TILE_SIZE);
+
+private:
+    std::vector<NodeId> order;
+    std::vector<Rect> needed;
+    std::vector<bool> visited;
+    std::vector<Tile> tiles;
+    std::vector<ConstImageView> views;
+
+    void propagate(NodeId id, Rect region);
+    void visit(NodeId id);
+};
+
+#endif
@@ -0,0 +1,652 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: pixel-kernels.cpp
+ *
+ * AVX2 kernels work on two interleaved pixels
+ * per 256-bit register, one pixel per 128-bit
+ * lane, so in-lane permutes broadcast a
+ * channel across its own pixel.
+ *******************************************/
+
+#include <immintrin.h>
+#include <cmath>
+#include "pixel-kernels.h"
+#include "color.h"
+#include "math.h"
+
+// Blend masks picking the alpha channel of both pixels in a register
+#define ALPHA_LANES 0x88
+// In-lane broadcasts of one channel across its pixel
+#define BROADCAST_R 0x00
+#define BROADCAST_G 0x55
+#define BROADCAST_B 0xAA
+#define BROADCAST_A 0xFF
+
+/************************************************************************
+* Scalar kernels, the reference behavior for every op.
+************************************************************************/
+static void scalarNegative(const col4f* in, col4f* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = negative(in[i]);
+    }
+}
+
+static void scalarScaleBrightness(const col4f* in, col4f* out, int count, float scale)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = scale * in[i];
+    }
+}
+
+static void scalarColorTint(const col4f* in, col4f* out, int count, col4f tint)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = blendOver(tint, in[i]);
+    }
+}
+
+static void scalarToGreyscale(const col4f* in, col4f* out, int count, col4f weights)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float avg = brightness(in[i] * weights);
+        out[i] = col4f(avg, avg, avg, in[i].a);
+    }
+}
+
+static void scalarThreshold(const col4f* in, col4f* out, int count, float threshold)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float avg = (in[i].r + in[i].g + in[i].b) / 3.0f;
+        if (avg > threshold)
+        {
+            out[i] = col4f(1.0f, 1.0f, 1.0f, 1.0f);
+        }
+        else
+        {
+            out[i] = col4f(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+}
+
+static void scalarThresholdColor(const col4f* in, col4f* out, int count, float threshold)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float avg = (in[i].r + in[i].g + in[i].b) / 3.0f;
+        if (avg > threshold)
+        {
+            out[i] = in[i];
+        }
+        else
+        {
+            out[i] = col4f(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+}
+
+static void scalarMaskify(const col4f* in, col4f* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = col4f(0.0f, 0.0f, 0.0f, brightness(in[i]));
+    }
+}
+
+static void scalarComposite(const col4f* in1, const col4f* in2, const col4f* mask, col4f* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = in1[i] * mask[i].a + in2[i] * (1.0f - mask[i].a);
+    }
+}
+
+static void scalarBlend(const col4f* in1, const col4f* in2, const float* t, col4f* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = col4f(
+            in1[i].r + t[i] * (in2[i].r - in1[i].r),
+            in1[i].g + t[i] * (in2[i].g - in1[i].g),
+            in1[i].b + t[i] * (in2[i].b - in1[i].b),
+            in1[i].a + t[i] * (in2[i].a - in1[i].a)
+        );
+    }
+}
+
+/*
+ * Porter-Duff over on straight alpha, unlike blendOver, which weighs bg
+ * by its blue. The fma calls pin the rounding so AVX2 can match it.
+ */
+static void scalarAlphaOver(const col4f* fg, const col4f* bg, col4f* out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float a = fg[i].a;
+        if (!(a > 0.0f))
+        {
+            out[i] = bg[i];
+            continue;
+        }
+        float below = bg[i].a * (1.0f - a);
+        float aOut = std::fma(bg[i].a, 1.0f - a, a);
+        out[i] = col4f(
+            std::fma(fg[i].r, a, bg[i].r * below) / aOut,
+            std::fma(fg[i].g, a, bg[i].g * below) / aOut,
+            std::fma(fg[i].b, a, bg[i].b * below) / aOut,
+            aOut
+        );
+    }
+}
+
+static inline col4f lerpPixel(const col4f& a, const col4f& b, float t)
+{
+    return col4f(a.r + t * (b.r - a.r), a.g + t * (b.g - a.g), a.b + t * (b.b - a.b), a.a + t * (b.a - a.a));
+}
+
+/*
+ * Sample i is at (u + i * du, v + i * dv), computed from i rather than
+ * accumulated so long spans don't drift. In range means the truncated
+ * top left pixel and its right and lower neighbors are in the image,
+ * the same test Viewport::drawImage has always used.
+ */
+static void affineSampleRange(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    float maxU = float(width - 1);
+    float maxV = float(height - 1);
+    for (int i = begin; i < end; i++)
+    {
+        float x = std::fma(float(i), du, u);
+        float y = std::fma(float(i), dv, v);
+        if (x > -1.0f && x < maxU && y > -1.0f && y < maxV)
+        {
+            int x0 = int(x);
+            int y0 = int(y);
+            float tx = x - float(x0);
+            float ty = y - float(y0);
+            const col4f* p = image + ptrdiff_t(y0) * width + x0;
+            col4f top = lerpPixel(p[0], p[1], tx);
+            col4f bottom = lerpPixel(p[width], p[width + 1], tx);
+            out[i - begin] = lerpPixel(top, bottom, ty);
+        }
+    }
+}
+
+static void scalarAffineSample(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    affineSampleRange(image, width, height, u, v, du, dv, out, begin, end);
+}
+
+static void clampedAffineSampleRange(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    float maxU = float(width - 1);
+    float maxV = float(height - 1);
+    for (int i = begin; i < end; i++)
+    {
+        float x = std::min(std::max(std::fma(float(i), du, u), 0.0f), maxU);
+        float y = std::min(std::max(std::fma(float(i), dv, v), 0.0f), maxV);
+        int x0 = int(x);
+        int y0 = int(y);
+        int x1 = std::min(x0 + 1, width - 1);
+        int y1 = std::min(y0 + 1, height - 1);
+        float tx = x - float(x0);
+        float ty = y - float(y0);
+        const col4f* top = image + ptrdiff_t(y0) * width;
+        const col4f* bottom = image + ptrdiff_t(y1) * width;
+        out[i - begin] = lerpPixel(lerpPixel(top[x0], top[x1], tx), lerpPixel(bottom[x0], bottom[x1], tx), ty);
+    }
+}
+
+static void scalarClampedAffineSample(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    clampedAffineSampleRange(image, width, height, u, v, du, dv, out, begin, end);
+}
+
+static void scalarAdjustHSV(const col4f* in, col4f* out, int count, col4f_hsv_t hsv)
+{
+    for (int i = 0; i < count; i++)
+    {
+        col4f_hsv_t pixel = colRGBAtoHSVA(in[i]);
+        pixel.h = pixel.h + hsv.h;
+        pixel.s = pixel.s * hsv.s;
+        pixel.v = pixel.v * hsv.v;
+        out[i] = colHSVAtoRGBA(pixel);
+    }
+}
+
+/************************************************************************
+* AVX2 kernels. Compiled for AVX2 regardless of the global flags, only
+* ever called after cpuHasAVX2(). An odd pixel at the end of a span
+* goes through the scalar kernel.
+************************************************************************/
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static inline __m256 load2(const col4f* p) { return _mm256_loadu_ps(&p->r); }
+AVX2 static inline void store2(col4f* p, __m256 v) { _mm256_storeu_ps(&p->r, v); }
+
+// (r + g + b) / 3 for each pixel, broadcast across the pixel's lane
+AVX2 static inline __m256 average3(__m256 v)
+{
+    __m256 r = _mm256_permute_ps(v, BROADCAST_R);
+    __m256 g = _mm256_permute_ps(v, BROADCAST_G);
+    __m256 b = _mm256_permute_ps(v, BROADCAST_B);
+    return _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(r, g), b), _mm256_set1_ps(3.0f));
+}
+
+AVX2 static void avx2Negative(const col4f* in, col4f* out, int count)
+{
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 v = load2(in + i);
+        store2(out + i, _mm256_blend_ps(_mm256_sub_ps(ones, v), v, ALPHA_LANES));
+    }
+    scalarNegative(in + i, out + i, count - i);
+}
+
+AVX2 static void avx2ScaleBrightness(const col4f* in, col4f* out, int count, float scale)
+{
+    const __m256 scales = _mm256_setr_ps(scale, scale, scale, 1.0f, scale, scale, scale, 1.0f);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        store2(out + i, _mm256_mul_ps(load2(in + i), scales));
+    }
+    scalarScaleBrightness(in + i, out + i, count - i, scale);
+}
+
+/*
+ * blendOver(tint, pixel) with the tint's terms hoisted out of the loop.
+ * Matches the scalar version exactly, including its use of bg.b in aOut.
+ */
+AVX2 static void avx2ColorTint(const col4f* in, col4f* out, int count, col4f tint)
+{
+    const col4f tintPremultiplied = tint * tint.a;
+    const __m256 fgPremultiplied = _mm256_setr_ps(
+        tintPremultiplied.r, tintPremultiplied.g, tintPremultiplied.b, 0.0f,
+        tintPremultiplied.r, tintPremultiplied.g, tintPremultiplied.b, 0.0f);
+    const __m256 fgAlpha = _mm256_set1_ps(tint.a);
+    const __m256 fgTransparency = _mm256_set1_ps(1.0f - tint.a);
+    const __m256 minAlpha = _mm256_set1_ps(0.001f);
+    const __m256 maxAlpha = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 bg = load2(in + i);
+        __m256 bgAlpha = _mm256_permute_ps(bg, BROADCAST_A);
+        __m256 bgBlue = _mm256_permute_ps(bg, BROADCAST_B);
+        __m256 aOut = _mm256_add_ps(fgAlpha, _mm256_mul_ps(bgBlue, fgTransparency));
+        aOut = _mm256_min_ps(_mm256_max_ps(aOut, minAlpha), maxAlpha);
+        __m256 bgTerm = _mm256_mul_ps(_mm256_mul_ps(bg, bgAlpha), fgTransparency);
+        __m256 pOut = _mm256_div_ps(_mm256_add_ps(fgPremultiplied, bgTerm), aOut);
+        store2(out + i, _mm256_blend_ps(pOut, aOut, ALPHA_LANES));
+    }
+    scalarColorTint(in + i, out + i, count - i, tint);
+}
+
+AVX2 static void avx2ToGreyscale(const col4f* in, col4f* out, int count, col4f weights)
+{
+    const __m256 w = _mm256_setr_ps(weights.r, weights.g, weights.b, weights.a,
+                                    weights.r, weights.g, weights.b, weights.a);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 v = load2(in + i);
+        __m256 avg = average3(_mm256_mul_ps(v, w));
+        store2(out + i, _mm256_blend_ps(avg, v, ALPHA_LANES));
+    }
+    scalarToGreyscale(in + i, out + i, count - i, weights);
+}
+
+AVX2 static void avx2Threshold(const col4f* in, col4f* out, int count, float threshold)
+{
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    const __m256 t = _mm256_set1_ps(threshold);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 above = _mm256_cmp_ps(average3(load2(in + i)), t, _CMP_GT_OQ);
+        store2(out + i, _mm256_and_ps(above, ones));
+    }
+    scalarThreshold(in + i, out + i, count - i, threshold);
+}
+
+AVX2 static void avx2ThresholdColor(const col4f* in, col4f* out, int count, float threshold)
+{
+    const __m256 t = _mm256_set1_ps(threshold);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 v = load2(in + i);
+        __m256 above = _mm256_cmp_ps(average3(v), t, _CMP_GT_OQ);
+        store2(out + i, _mm256_and_ps(above, v));
+    }
+    scalarThresholdColor(in + i, out + i, count - i, threshold);
+}
+
+AVX2 static void avx2Maskify(const col4f* in, col4f* out, int count)
+{
+    const __m256 zeros = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        store2(out + i, _mm256_blend_ps(zeros, average3(load2(in + i)), ALPHA_LANES));
+    }
+    scalarMaskify(in + i, out + i, count - i);
+}
+
+AVX2 static void avx2Composite(const col4f* in1, const col4f* in2, const col4f* mask, col4f* out, int count)
+{
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 fg = load2(in1 + i);
+        __m256 bg = load2(in2 + i);
+        __m256 m = _mm256_permute_ps(load2(mask + i), BROADCAST_A);
+        __m256 mixed = _mm256_add_ps(_mm256_mul_ps(fg, m), _mm256_mul_ps(bg, _mm256_sub_ps(ones, m)));
+        store2(out + i, _mm256_blend_ps(mixed, fg, ALPHA_LANES));
+    }
+    scalarComposite(in1 + i, in2 + i, mask + i, out + i, count - i);
+}
+
+AVX2 static void avx2Blend(const col4f* in1, const col4f* in2, const float* t, col4f* out, int count)
+{
+    // Pixel 0's weight across the low lane, pixel 1's across the high
+    const __m256i spread = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 a = load2(in1 + i);
+        __m256 b = load2(in2 + i);
+        __m256 weights = _mm256_castps128_ps256(_mm_castpd_ps(_mm_load_sd((const double*) (t + i))));
+        weights = _mm256_permutevar8x32_ps(weights, spread);
+        store2(out + i, _mm256_add_ps(a, _mm256_mul_ps(weights, _mm256_sub_ps(b, a))));
+    }
+    scalarBlend(in1 + i, in2 + i, t + i, out + i, count - i);
+}
+
+/*
+ * Coordinates, bounds tests and pixel offsets for 8 samples at a time.
+ * Runs entirely outside the image cost one compare, the rest are
+ * filtered a pixel per 128-bit register from the stored offsets.
+ */
+AVX2 static void avx2AffineSample(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 minimum = _mm256_set1_ps(-1.0f);
+    const __m256 maxU = _mm256_set1_ps(float(width - 1));
+    const __m256 maxV = _mm256_set1_ps(float(height - 1));
+    const __m256i stride = _mm256_set1_epi32(width);
+    alignas(32) int offsets[8];
+    alignas(32) float fractionX[8];
+    alignas(32) float fractionY[8];
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 steps = _mm256_add_ps(_mm256_set1_ps(float(i)), lanes);
+        __m256 x = _mm256_fmadd_ps(steps, _mm256_set1_ps(du), _mm256_set1_ps(u));
+        __m256 y = _mm256_fmadd_ps(steps, _mm256_set1_ps(dv), _mm256_set1_ps(v));
+        __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(x, minimum, _CMP_GT_OQ), _mm256_cmp_ps(x, maxU, _CMP_LT_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y, minimum, _CMP_GT_OQ), _mm256_cmp_ps(y, maxV, _CMP_LT_OQ)));
+        int lanesInside = _mm256_movemask_ps(inside);
+        if (lanesInside == 0)
+        {
+            continue;
+        }
+        __m256i x0 = _mm256_cvttps_epi32(x);
+        __m256i y0 = _mm256_cvttps_epi32(y);
+        _mm256_store_si256((__m256i*) offsets, _mm256_add_epi32(_mm256_mullo_epi32(y0, stride), x0));
+        _mm256_store_ps(fractionX, _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0)));
+        _mm256_store_ps(fractionY, _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0)));
+        for (int lane = 0; lane < 8; lane++)
+        {
+            if (lanesInside & (1 << lane))
+            {
+                const col4f* p = image + offsets[lane];
+                __m128 tx = _mm_set1_ps(fractionX[lane]);
+                __m128 topLeft = _mm_loadu_ps(&p[0].r);
+                __m128 bottomLeft = _mm_loadu_ps(&p[width].r);
+                __m128 top = _mm_add_ps(topLeft, _mm_mul_ps(tx, _mm_sub_ps(_mm_loadu_ps(&p[1].r), topLeft)));
+                __m128 bottom = _mm_add_ps(bottomLeft, _mm_mul_ps(tx, _mm_sub_ps(_mm_loadu_ps(&p[width + 1].r), bottomLeft)));
+                __m128 sample = _mm_add_ps(top, _mm_mul_ps(_mm_set1_ps(fractionY[lane]), _mm_sub_ps(bottom, top)));
+                _mm_storeu_ps(&out[i - begin + lane].r, sample);
+            }
+        }
+    }
+    affineSampleRange(image, width, height, u, v, du, dv, out + (i - begin), i, end);
+}
+
+AVX2 static void avx2AlphaOver(const col4f* fg, const col4f* bg, col4f* out, int count)
+{
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    const __m256 zeros = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m256 top = load2(fg + i);
+        __m256 bottom = load2(bg + i);
+        __m256 a = _mm256_permute_ps(top, BROADCAST_A);
+        __m256 transparency = _mm256_sub_ps(ones, a);
+        __m256 bottomAlpha = _mm256_permute_ps(bottom, BROADCAST_A);
+        __m256 below = _mm256_mul_ps(bottomAlpha, transparency);
+        __m256 aOut = _mm256_fmadd_ps(bottomAlpha, transparency, a);
+        __m256 mixed = _mm256_div_ps(_mm256_fmadd_ps(top, a, _mm256_mul_ps(bottom, below)), aOut);
+        mixed = _mm256_blend_ps(mixed, aOut, ALPHA_LANES);
+        store2(out + i, _mm256_blendv_ps(bottom, mixed, _mm256_cmp_ps(a, zeros, _CMP_GT_OQ)));
+    }
+    scalarAlphaOver(fg + i, bg + i, out + i, count - i);
+}
+
+AVX2 static void avx2ClampedAffineSample(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end)
+{
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxU = _mm256_set1_ps(float(width - 1));
+    const __m256 maxV = _mm256_set1_ps(float(height - 1));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lastX = _mm256_set1_epi32(width - 1);
+    const __m256i lastY = _mm256_set1_epi32(height - 1);
+    const __m256i stride = _mm256_set1_epi32(width);
+    alignas(32) int left[8];
+    alignas(32) int right[8];
+    alignas(32) int top[8];
+    alignas(32) int bottom[8];
+    alignas(32) float fractionX[8];
+    alignas(32) float fractionY[8];
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 steps = _mm256_add_ps(_mm256_set1_ps(float(i)), lanes);
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_fmadd_ps(steps, _mm256_set1_ps(du), _mm256_set1_ps(u)), zero), maxU);
+        __m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_fmadd_ps(steps, _mm256_set1_ps(dv), _mm256_set1_ps(v)), zero), maxV);
+        __m256i x0 = _mm256_cvttps_epi32(x);
+        __m256i y0 = _mm256_cvttps_epi32(y);
+        __m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), lastY);
+        _mm256_store_si256((__m256i*) left, x0);
+        _mm256_store_si256((__m256i*) right, _mm256_min_epi32(_mm256_add_epi32(x0, one), lastX));
+        _mm256_store_si256((__m256i*) top, _mm256_mullo_epi32(y0, stride));
+        _mm256_store_si256((__m256i*) bottom, _mm256_mullo_epi32(y1, stride));
+        _mm256_store_ps(fractionX, _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0)));
+        _mm256_store_ps(fractionY, _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0)));
+        for (int lane = 0; lane < 8; lane++)
+        {
+            const col4f* upper = image + top[lane];
+            const col4f* lower = image + bottom[lane];
+            __m128 tx = _mm_set1_ps(fractionX[lane]);
+            __m128 topLeft = _mm_loadu_ps(&upper[left[lane]].r);
+            __m128 bottomLeft = _mm_loadu_ps(&lower[left[lane]].r);
+            __m128 upperMix = _mm_add_ps(topLeft, _mm_mul_ps(tx, _mm_sub_ps(_mm_loadu_ps(&upper[right[lane]].r), topLeft)));
+            __m128 lowerMix = _mm_add_ps(bottomLeft, _mm_mul_ps(tx, _mm_sub_ps(_mm_loadu_ps(&lower[right[lane]].r), bottomLeft)));
+            __m128 sample = _mm_add_ps(upperMix, _mm_mul_ps(_mm_set1_ps(fractionY[lane]), _mm_sub_ps(lowerMix, upperMix)));
+            _mm_storeu_ps(&out[i - begin + lane].r, sample);
+        }
+    }
+    clampedAffineSampleRange(image, width, height, u, v, du, dv, out + (i - begin), i, end);
+}
+
+/*
+ * Eight interleaved pixels in four registers to one register per channel
+ * and back. Pixels come out in lane order 0 2 4 6 1 3 5 7, which the
+ * reverse transpose undoes.
+ */
+AVX2 static inline void transpose8(const col4f* p, __m256& r, __m256& g, __m256& b, __m256& a)
+{
+    __m256 rg01 = _mm256_unpacklo_ps(load2(p), load2(p + 2));
+    __m256 ba01 = _mm256_unpackhi_ps(load2(p), load2(p + 2));
+    __m256 rg45 = _mm256_unpacklo_ps(load2(p + 4), load2(p + 6));
+    __m256 ba45 = _mm256_unpackhi_ps(load2(p + 4), load2(p + 6));
+    r = _mm256_shuffle_ps(rg01, rg45, 0x44);
+    g = _mm256_shuffle_ps(rg01, rg45, 0xEE);
+    b = _mm256_shuffle_ps(ba01, ba45, 0x44);
+    a = _mm256_shuffle_ps(ba01, ba45, 0xEE);
+}
+
+AVX2 static inline void untranspose8(col4f* p, __m256 r, __m256 g, __m256 b, __m256 a)
+{
+    __m256 rg02 = _mm256_unpacklo_ps(r, g);
+    __m256 rg46 = _mm256_unpackhi_ps(r, g);
+    __m256 ba02 = _mm256_unpacklo_ps(b, a);
+    __m256 ba46 = _mm256_unpackhi_ps(b, a);
+    store2(p, _mm256_shuffle_ps(rg02, ba02, 0x44));
+    store2(p + 2, _mm256_shuffle_ps(rg02, ba02, 0xEE));
+    store2(p + 4, _mm256_shuffle_ps(rg46, ba46, 0x44));
+    store2(p + 6, _mm256_shuffle_ps(rg46, ba46, 0xEE));
+}
+
+/*
+ * colRGBAtoHSVA, adjust, colHSVAtoRGBA for eight pixels at a time, all in
+ * registers. Hue sectors are picked with compares and blends rather than
+ * branches. The way back uses the equivalent closed form
+ *     channel(n) = V - C * clamp(min(k, 4 - k), 0, 1),  k = (n + H / 60) mod 6
+ * with n = 5, 3, 1 for r, g, b, which matches the scalar sector table to
+ * within float rounding.
+ */
+AVX2 static void avx2AdjustHSV(const col4f* in, col4f* out, int count, col4f_hsv_t hsv)
+{
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    const __m256 sixty = _mm256_set1_ps(60.0f);
+    const __m256 six = _mm256_set1_ps(6.0f);
+    const __m256 full = _mm256_set1_ps(360.0f);
+    const __m256 inverseFull = _mm256_set1_ps(1.0f / 360.0f);
+    const __m256 inverseSixty = _mm256_set1_ps(1.0f / 60.0f);
+    const __m256 hueShift = _mm256_set1_ps(hsv.h);
+    const __m256 saturationScale = _mm256_set1_ps(hsv.s);
+    const __m256 valueScale = _mm256_set1_ps(hsv.v);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 r, g, b, a;
+        transpose8(in + i, r, g, b, a);
+
+        // RGB -> HSV
+        __m256 cMax = _mm256_max_ps(_mm256_max_ps(r, g), b);
+        __m256 cMin = _mm256_min_ps(_mm256_min_ps(r, g), b);
+        __m256 delta = _mm256_sub_ps(cMax, cMin);
+        __m256 hasHue = _mm256_cmp_ps(delta, zeros, _CMP_GT_OQ);
+        __m256 inverseDelta = _mm256_div_ps(ones, _mm256_blendv_ps(ones, delta, hasHue));
+        __m256 hueR = _mm256_mul_ps(_mm256_sub_ps(g, b), inverseDelta);
+        __m256 hueG = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(b, r), inverseDelta), _mm256_set1_ps(2.0f));
+        __m256 hueB = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(r, g), inverseDelta), _mm256_set1_ps(4.0f));
+        __m256 hue = _mm256_blendv_ps(hueB, hueG, _mm256_cmp_ps(cMax, g, _CMP_EQ_OQ));
+        hue = _mm256_blendv_ps(hue, hueR, _mm256_cmp_ps(cMax, r, _CMP_EQ_OQ));
+        hue = _mm256_and_ps(hasHue, _mm256_mul_ps(sixty, hue));
+        __m256 saturation = _mm256_div_ps(delta, _mm256_blendv_ps(ones, cMax, hasHue));
+        saturation = _mm256_and_ps(_mm256_and_ps(hasHue, _mm256_cmp_ps(cMax, zeros, _CMP_GT_OQ)), saturation);
+        __m256 value = cMax;
+
+        // Adjust
+        hue = _mm256_add_ps(hue, hueShift);
+        saturation = _mm256_mul_ps(saturation, saturationScale);
+        value = _mm256_mul_ps(value, valueScale);
+
+        // HSV -> RGB, hue wrapped into [0, 360)
+        hue = _mm256_sub_ps(hue, _mm256_mul_ps(full, _mm256_floor_ps(_mm256_mul_ps(hue, inverseFull))));
+        saturation = _mm256_min_ps(_mm256_max_ps(saturation, zeros), ones);
+        value = _mm256_min_ps(_mm256_max_ps(value, zeros), ones);
+        __m256 chroma = _mm256_mul_ps(value, saturation);
+        __m256 sector = _mm256_mul_ps(hue, inverseSixty);
+        __m256 channels[3];
+        const float offsets[3] = { 5.0f, 3.0f, 1.0f };
+        for (int c = 0; c < 3; c++)
+        {
+            __m256 k = _mm256_add_ps(_mm256_set1_ps(offsets[c]), sector);
+            k = _mm256_sub_ps(k, _mm256_and_ps(_mm256_cmp_ps(k, six, _CMP_GE_OQ), six));
+            __m256 t = _mm256_min_ps(k, _mm256_sub_ps(_mm256_set1_ps(4.0f), k));
+            t = _mm256_min_ps(_mm256_max_ps(t, zeros), ones);
+            channels[c] = _mm256_sub_ps(value, _mm256_mul_ps(chroma, t));
+        }
+        untranspose8(out + i, channels[0], channels[1], channels[2], a);
+    }
+    scalarAdjustHSV(in + i, out + i, count - i, hsv);
+}
+
+static const PixelKernels scalarKernels =
+{
+    "scalar",
+    scalarNegative,
+    scalarScaleBrightness,
+    scalarColorTint,
+    scalarToGreyscale,
+    scalarThreshold,
+    scalarThresholdColor,
+    scalarMaskify,
+    scalarComposite,
+    scalarAdjustHSV,
+    scalarBlend,
+    scalarAffineSample,
+    scalarClampedAffineSample,
+    scalarAlphaOver
+};
+
+static const PixelKernels avx2Kernels =
+{
+    "avx2",
+    avx2Negative,
+    avx2ScaleBrightness,
+    avx2ColorTint,
+    avx2ToGreyscale,
+    avx2Threshold,
+    avx2ThresholdColor,
+    avx2Maskify,
+    avx2Composite,
+    avx2AdjustHSV,
+    avx2Blend,
+    avx2AffineSample,
+    avx2ClampedAffineSample,
+    avx2AlphaOver
+};
+
+bool cpuHasAVX2()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return hasAVX2;
+#else
+    return false;
+#endif
+}
+
+const PixelKernels& scalarPixelKernels()
+{
+    return scalarKernels;
+}
+
+const PixelKernels& avx2PixelKernels()
+{
+    return avx2Kernels;
+}
+
+const PixelKernels& pixelKernels()
+{
+    static const PixelKernels& selected = cpuHasAVX2() ? avx2Kernels : scalarKernels;
+    return selected;
+}
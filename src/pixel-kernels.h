@@ -0,0 +1,46 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: pixel-kernels.h
+ *
+ * Per-pixel ImagePipeline operations over contiguous spans of col4f.
+ * Every op has a scalar version and an explicitly vectorized AVX2
+ * version. The AVX2 table is picked at runtime when the CPU has it.
+************************************************************************/
+
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include "color.h"
+
+// One entry per op. in and out may be the same span.
+struct PixelKernels
+{
+    const char* name;
+    void (*negative)(const col4f* in, col4f* out, int count);
+    void (*scaleBrightness)(const col4f* in, col4f* out, int count, float scale);
+    void (*colorTint)(const col4f* in, col4f* out, int count, col4f tint);
+    void (*toGreyscale)(const col4f* in, col4f* out, int count, col4f weights);
+    void (*threshold)(const col4f* in, col4f* out, int count, float threshold);
+    void (*thresholdColor)(const col4f* in, col4f* out, int count, float threshold);
+    void (*maskify)(const col4f* in, col4f* out, int count);
+    void (*composite)(const col4f* in1, const col4f* in2, const col4f* mask, col4f* out, int count);
+    void (*adjustHSV)(const col4f* in, col4f* out, int count, col4f_hsv_t hsv);
+    // in1 + t * (in2 - in1), one weight per pixel
+    void (*blend)(const col4f* in1, const col4f* in2, const float* t, col4f* out, int count);
+    // Bilinear samples of a width x height image at (u + i * du, v + i * dv)
+    // for i in [begin, end), into out[i - begin]. Positions depend only on
+    // i, so any split of a row samples it the same. Samples whose 2x2
+    // footprint leaves the image are skipped, leaving out as it was.
+    void (*affineSample)(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end);
+    // As affineSample, but every sample is written, reading clamped to the edges
+    void (*clampedAffineSample)(const col4f* image, int width, int height, float u, float v, float du, float dv, col4f* out, int begin, int end);
+    // Straight alpha fg over bg. Fully transparent fg leaves bg exactly as it was.
+    void (*alphaOver)(const col4f* fg, const col4f* bg, col4f* out, int count);
+};
+
+bool cpuHasAVX2();
+const PixelKernels& scalarPixelKernels();
+const PixelKernels& avx2PixelKernels(); // Only call when cpuHasAVX2()
+const PixelKernels& pixelKernels(); // Best table for this CPU
+
+#endif
@@ -0,0 +1,403 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: planar-image.cpp
+ *
+ * PlanarImage storage and the planar
+ * ImagePipeline overloads. Loops run over
+ * whole padded planes so they vectorize
+ * without scalar tails, split into chunks
+ * of whole lanes across the thread pool.
+ *******************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "planar-image.h"
+#include "image.h"
+#include "math.h"
+#include "thread-pool.h"
+
+// Smallest chunk of a plane handed to the thread pool, the same as the
+// interleaved ops hand out in pixels
+static const int PLANE_GRAIN = 16 * 1024;
+
+// Run span(begin, end) over [0, count) on the thread pool. count and
+// every chunk edge but the last are multiples of PLANE_LANES.
+template <typename F>
+static void parallelPlane(int count, F&& span)
+{
+    int lanes = (count + PLANE_LANES - 1) / PLANE_LANES;
+    threadPool().parallelFor(lanes, PLANE_GRAIN / PLANE_LANES, [&](int l0, int l1)
+    {
+        span(l0 * PLANE_LANES, std::min(l1 * PLANE_LANES, count));
+    });
+}
+
+// Alpha passed through, for the ops that only touch rgb
+static void copyAlpha(const PlanarImage& input, PlanarImage& output, int begin, int end)
+{
+    if (&input != &output)
+    {
+        std::copy(input.a.data() + begin, input.a.data() + end, output.a.data() + begin);
+    }
+}
+
+PlanarImage::PlanarImage()
+{
+    this->width = 0;
+    this->height = 0;
+    this->aspectRatio = 1.0f;
+    this->pixelCount = 0;
+    this->planeSize = 0;
+}
+
+PlanarImage::PlanarImage(int width, int height)
+{
+    this->resize(width, height);
+}
+
+void PlanarImage::resize(int width, int height)
+{
+    if (width >= 0 && height >= 0)
+    {
+        this->width = width;
+        this->height = height;
+        this->aspectRatio = float(width) / float(height);
+        this->pixelCount = width * height;
+        this->planeSize = (pixelCount + PLANE_LANES - 1) / PLANE_LANES * PLANE_LANES;
+        r.resize(planeSize, 0.0f);
+        g.resize(planeSize, 0.0f);
+        b.resize(planeSize, 0.0f);
+        a.resize(planeSize, 0.0f);
+    }
+}
+
+void PlanarImage::read(const Image& image)
+{
+    resize(image.width, image.height);
+    const col4f* pixels = image.buffer.data();
+    float* rOut = r.data();
+    float* gOut = g.data();
+    float* bOut = b.data();
+    float* aOut = a.data();
+    parallelPlane(pixelCount, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            rOut[i] = pixels[i].r;
+            gOut[i] = pixels[i].g;
+            bOut[i] = pixels[i].b;
+            aOut[i] = pixels[i].a;
+        }
+    });
+}
+
+void PlanarImage::write(Image& image) const
+{
+    image.resize(width, height);
+    col4f* pixels = image.buffer.data();
+    const float* rIn = r.data();
+    const float* gIn = g.data();
+    const float* bIn = b.data();
+    const float* aIn = a.data();
+    parallelPlane(pixelCount, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            pixels[i] = col4f(rIn[i], gIn[i], bIn[i], aIn[i]);
+        }
+    });
+}
+
+void ImagePipeline::toNegative(const PlanarImage& input, PlanarImage& output)
+{
+    output.resize(input.width, input.height);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float* in = input.plane(c);
+            float* out = output.plane(c);
+            for (int i = begin; i < end; i++)
+            {
+                out[i] = 1.0f - in[i];
+            }
+        }
+        copyAlpha(input, output, begin, end);
+    });
+}
+
+void ImagePipeline::scaleContrast(const PlanarImage& input, PlanarImage& output, float contrast)
+{
+    output.resize(input.width, input.height);
+    float higherBound = contrast;
+    float lowerBound = 1.0f / contrast;
+    float deltaOut = higherBound - lowerBound;
+    // Each chunk keeps one running min/max per lane, so the reduction
+    // vectorizes, then folds them into the totals. min and max don't
+    // depend on the order, so neither does the result.
+    float min = std::numeric_limits<float>::infinity();
+    float max = - std::numeric_limits<float>::infinity();
+    std::mutex fold;
+    int fullLanes = input.pixelCount / PLANE_LANES * PLANE_LANES;
+    parallelPlane(input.pixelCount, [&](int begin, int end)
+    {
+        float mins[PLANE_LANES];
+        float maxs[PLANE_LANES];
+        for (int lane = 0; lane < PLANE_LANES; lane++)
+        {
+            mins[lane] = std::numeric_limits<float>::infinity();
+            maxs[lane] = - std::numeric_limits<float>::infinity();
+        }
+        int laneEnd = std::min(end, fullLanes);
+        for (int c = 0; c < 3; c++)
+        {
+            const float* in = input.plane(c);
+            for (int i = begin; i < laneEnd; i += PLANE_LANES)
+            {
+                for (int lane = 0; lane < PLANE_LANES; lane++)
+                {
+                    mins[lane] = (in[i + lane] < mins[lane]) ? in[i + lane] : mins[lane];
+                    maxs[lane] = (in[i + lane] > maxs[lane]) ? in[i + lane] : maxs[lane];
+                }
+            }
+            for (int i = std::max(begin, fullLanes); i < end; i++)
+            {
+                mins[0] = std::min(mins[0], in[i]);
+                maxs[0] = std::max(maxs[0], in[i]);
+            }
+        }
+        std::lock_guard<std::mutex> lock(fold);
+        min = std::min(min, *std::min_element(mins, mins + PLANE_LANES));
+        max = std::max(max, *std::max_element(maxs, maxs + PLANE_LANES));
+    });
+    float scale = deltaOut / (max - min);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float* in = input.plane(c);
+            float* out = output.plane(c);
+            for (int i = begin; i < end; i++)
+            {
+                out[i] = (in[i] - min) * scale + lowerBound;
+            }
+        }
+        copyAlpha(input, output, begin, end);
+    });
+}
+
+void ImagePipeline::scaleBrightness(const PlanarImage& input, PlanarImage& output, float scale)
+{
+    output.resize(input.width, input.height);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float* in = input.plane(c);
+            float* out = output.plane(c);
+            for (int i = begin; i < end; i++)
+            {
+                out[i] = scale * in[i];
+            }
+        }
+        copyAlpha(input, output, begin, end);
+    });
+}
+
+void ImagePipeline::toGreyscale(const PlanarImage& input, PlanarImage& output, col4f weights)
+{
+    output.resize(input.width, input.height);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        const float* r = input.r.data();
+        const float* g = input.g.data();
+        const float* b = input.b.data();
+        float* rOut = output.r.data();
+        float* gOut = output.g.data();
+        float* bOut = output.b.data();
+        // Outputs may alias inputs, but only at the same index
+        #pragma GCC ivdep
+        for (int i = begin; i < end; i++)
+        {
+            float avg = (r[i] * weights.r + g[i] * weights.g + b[i] * weights.b) / 3.0f;
+            rOut[i] = avg;
+            gOut[i] = avg;
+            bOut[i] = avg;
+        }
+        copyAlpha(input, output, begin, end);
+    });
+}
+
+void ImagePipeline::threshold(const PlanarImage& input, PlanarImage& output, float threshold)
+{
+    output.resize(input.width, input.height);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        const float* r = input.r.data();
+        const float* g = input.g.data();
+        const float* b = input.b.data();
+        float* rOut = output.r.data();
+        float* gOut = output.g.data();
+        float* bOut = output.b.data();
+        float* aOut = output.a.data();
+        // Outputs may alias inputs, but only at the same index
+        #pragma GCC ivdep
+        for (int i = begin; i < end; i++)
+        {
+            float avg = (r[i] + g[i] + b[i]) / 3.0f;
+            float value = (avg > threshold) ? 1.0f : 0.0f;
+            rOut[i] = value;
+            gOut[i] = value;
+            bOut[i] = value;
+            aOut[i] = value;
+        }
+    });
+}
+
+void ImagePipeline::thresholdColor(const PlanarImage& input, PlanarImage& output, float thresh)
+{
+    output.resize(input.width, input.height);
+    parallelPlane(input.planeSize, [&](int begin, int end)
+    {
+        const float* r = input.r.data();
+        const float* g = input.g.data();
+        const float* b = input.b.data();
+        const float* a = input.a.data();
+        float* rOut = output.r.data();
+        float* gOut = output.g.data();
+        float* bOut = output.b.data();
+        float* aOut = output.a.data();
+        // Outputs may alias inputs, but only at the same index
+        #pragma GCC ivdep
+        for (int i = begin; i < end; i++)
+        {
+            float avg = (r[i] + g[i] + b[i]) / 3.0f;
+            bool keep = avg > thresh;
+            rOut[i] = keep ? r[i] : 0.0f;
+            gOut[i] = keep ? g[i] : 0.0f;
+            bOut[i] = keep ? b[i] : 0.0f;
+            aOut[i] = keep ? a[i] : 0.0f;
+        }
+    });
+}
+
+/************************************************************************
+* Same as the interleaved gaussianBlur, one plane at a time, rgb only.
+* Rows blur into planarTemp, then columns blur back in cache-sized
+* strips. Both passes split the rows into bands across the thread pool.
+************************************************************************/
+void ImagePipeline::gaussianBlur(const PlanarImage& input, PlanarImage& output, int kernel)
+{
+    if (kernel % 2 == 0)
+    {
+        kernel++;
+    }
+    std::vector<float> weights = gaussianWeights(kernel);
+    int offset = int(weights.size()) - 1;
+    int width = input.width;
+    int height = input.height;
+    int interiorStart = std::min(offset, width);
+    int interiorEnd = std::max(interiorStart, width - offset);
+    int stripWidth = clamp(BLUR_STRIP_BYTES / int(sizeof(float) * (2 * offset + 1)), PLANE_LANES, std::max(width, PLANE_LANES));
+    planarTemp.resize(width, height);
+    output.resize(width, height);
+
+    // Horizontal pass, input -> planarTemp
+    threadPool().parallelFor(height, 1, [&](int y0, int y1)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            for (int y = y0; y < y1; y++)
+            {
+                const float* rowIn = input.plane(c) + y * width;
+                float* rowOut = planarTemp.plane(c) + y * width;
+                for (int x = interiorStart; x < interiorEnd; x++)
+                {
+                    rowOut[x] = weights[0] * rowIn[x];
+                }
+                for (int i = 1; i <= offset; i++)
+                {
+                    const float w = weights[i];
+                    for (int x = interiorStart; x < interiorEnd; x++)
+                    {
+                        rowOut[x] += w * (rowIn[x - i] + rowIn[x + i]);
+                    }
+                }
+                auto border = [&](int x)
+                {
+                    float sum = weights[0] * rowIn[x];
+                    for (int i = 1; i <= offset; i++)
+                    {
+                        sum += weights[i] * (rowIn[clamp(x - i, 0, width - 1)] + rowIn[clamp(x + i, 0, width - 1)]);
+                    }
+                    rowOut[x] = sum;
+                };
+                for (int x = 0; x < interiorStart; x++)
+                {
+                    border(x);
+                }
+                for (int x = interiorEnd; x < width; x++)
+                {
+                    border(x);
+                }
+            }
+        }
+    });
+
+    // Vertical pass, planarTemp -> output
+    threadPool().parallelFor(height, 1, [&](int y0, int y1)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float* src = planarTemp.plane(c);
+            float* dst = output.plane(c);
+            for (int stripStart = 0; stripStart < width; stripStart += stripWidth)
+            {
+                int stripEnd = std::min(stripStart + stripWidth, width);
+                for (int y = y0; y < y1; y++)
+                {
+                    float* out = dst + y * width;
+                    const float* center = src + y * width;
+                    for (int x = stripStart; x < stripEnd; x++)
+                    {
+                        out[x] = weights[0] * center[x];
+                    }
+                    for (int j = 1; j <= offset; j++)
+                    {
+                        const float w = weights[j];
+                        const float* up = src + clamp(y - j, 0, height - 1) * width;
+                        const float* down = src + clamp(y + j, 0, height - 1) * width;
+                        for (int x = stripStart; x < stripEnd; x++)
+                        {
+                            out[x] += w * (up[x] + down[x]);
+                        }
+                    }
+                }
+            }
+        }
+        copyAlpha(input, output, y0 * width, y1 * width);
+    });
+}
+
+void ImagePipeline::composite(const PlanarImage& imgIn1, const PlanarImage& imgIn2, PlanarImage& imgOut, const PlanarImage& mask)
+{
+    imgOut.resize(imgIn1.width, imgIn1.height);
+    const float* m = mask.a.data();
+    parallelPlane(imgIn1.planeSize, [&](int begin, int end)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float* in1 = imgIn1.plane(c);
+            const float* in2 = imgIn2.plane(c);
+            float* out = imgOut.plane(c);
+            for (int i = begin; i < end; i++)
+            {
+                out[i] = in1[i] * m[i] + in2[i] * (1.0f - m[i]);
+            }
+        }
+        copyAlpha(imgIn1, imgOut, begin, end);
+    });
+}
@@ -0,0 +1,177 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: point-chain.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include "point-chain.h"
+#include "pixel-kernels.h"
+#include "image.h"
+#include "thread-pool.h"
+
+// Fewest pixels per thread pool chunk, a few dozen blocks
+static const int CHAIN_GRAIN = 32 * CHAIN_BLOCK;
+
+// Block buffers for whichever thread runs a span, slot 0 is the chain's
+// scratch and the rest hold widened half pixels
+static col4f* threadBlock(int slot = 0)
+{
+    thread_local std::vector<col4f> blocks[4] = {
+        std::vector<col4f>(CHAIN_BLOCK), std::vector<col4f>(CHAIN_BLOCK),
+        std::vector<col4f>(CHAIN_BLOCK), std::vector<col4f>(CHAIN_BLOCK)
+    };
+    return blocks[slot].data();
+}
+
+/************************************************************************
+* Run one op over a span. in and out may be the same span.
+* offset is the span's first pixel, for ops that read other images.
+************************************************************************/
+static void applyOp(const PixelKernels& kernels, const PointOp& op, const col4f* in, col4f* out, int offset, int count)
+{
+    switch (op.type)
+    {
+        case PointOpType::Negative:
+            kernels.negative(in, out, count);
+            break;
+        case PointOpType::ScaleBrightness:
+            kernels.scaleBrightness(in, out, count, op.value);
+            break;
+        case PointOpType::ColorTint:
+            kernels.colorTint(in, out, count, op.color);
+            break;
+        case PointOpType::ToGreyscale:
+            kernels.toGreyscale(in, out, count, op.color);
+            break;
+        case PointOpType::Threshold:
+            kernels.threshold(in, out, count, op.value);
+            break;
+        case PointOpType::ThresholdColor:
+            kernels.thresholdColor(in, out, count, op.value);
+            break;
+        case PointOpType::AdjustHSV:
+            kernels.adjustHSV(in, out, count, op.hsv);
+            break;
+        case PointOpType::Maskify:
+            kernels.maskify(in, out, count);
+            break;
+        case PointOpType::Composite:
+            kernels.composite(in, op.image1->buffer.data() + offset, op.image2->buffer.data() + offset, out, count);
+            break;
+        case PointOpType::CompositeMasked:
+            kernels.composite(op.image1->buffer.data() + offset, op.image2->buffer.data() + offset, in, out, count);
+            break;
+    }
+}
+
+/************************************************************************
+* Push count pixels through the whole chain. The first op reads straight
+* from in, the last writes straight to out, and everything in between
+* stays in a block-sized buffer. offset is the first pixel's index in
+* the full frame, for ops that read other images.
+************************************************************************/
+static void applySpan(const PixelKernels& kernels, const PointChain& chain, const col4f* in, col4f* out, int offset, int count)
+{
+    col4f* block = threadBlock();
+    int last = int(chain.ops.size()) - 1;
+    for (int start = 0; start < count; start += CHAIN_BLOCK)
+    {
+        int blockCount = std::min(CHAIN_BLOCK, count - start);
+        const col4f* src = in + start;
+        for (int i = 0; i <= last; i++)
+        {
+            col4f* dst = (i == last) ? out + start : block;
+            applyOp(kernels, chain.ops[i], src, dst, offset + start, blockCount);
+            src = dst;
+        }
+    }
+}
+
+void ImagePipeline::apply(const PointChain& chain, const Image& input, Image& output)
+{
+    output.resize(input.width, input.height);
+    if (chain.ops.empty())
+    {
+        output.read(input);
+        return;
+    }
+    const PixelKernels& kernels = pixelKernels();
+    const col4f* in = input.buffer.data();
+    col4f* out = output.buffer.data();
+    threadPool().parallelFor(input.pixelCount, CHAIN_GRAIN, [&](int begin, int end)
+    {
+        applySpan(kernels, chain, in + begin, out + begin, begin, end - begin);
+    });
+}
+
+// Only the pixels inside region are written
+void ImagePipeline::apply(const PointChain& chain, const Image& input, Image& output, Rect region)
+{
+    output.resize(input.width, input.height);
+    apply(chain, view(input), view(output), input.width, input.height, region);
+}
+
+void ImagePipeline::apply(const PointChain& chain, ConstImageView input, ImageView output, int width, int height, Rect region)
+{
+    region = intersect(region, { 0, 0, width, height });
+    const PixelKernels& kernels = pixelKernels();
+    threadPool().parallelFor(region.height(), 1, [&](int y0, int y1)
+    {
+        for (int y = region.y0 + y0; y < region.y0 + y1; y++)
+        {
+            const col4f* in = input.at(region.x0, y);
+            col4f* out = output.at(region.x0, y);
+            if (chain.ops.empty())
+            {
+                if (in != out)
+                {
+                    std::copy(in, in + region.width(), out);
+                }
+                continue;
+            }
+            applySpan(kernels, chain, in, out, y * width + region.x0, region.width());
+        }
+    });
+}
+
+void ImagePipeline::apply(const PointChain& chain, const HalfImage& input, HalfImage& output)
+{
+    output.resize(input.width, input.height);
+    const PixelKernels& kernels = pixelKernels();
+    threadPool().parallelFor(input.pixelCount, CHAIN_GRAIN, [&](int begin, int end)
+    {
+        col4f* pixels = threadBlock(1);
+        for (int start = begin; start < end; start += CHAIN_BLOCK)
+        {
+            int count = std::min(CHAIN_BLOCK, end - start);
+            widenPixels(input.buffer.data() + start, pixels, count);
+            if (!chain.ops.empty())
+            {
+                applySpan(kernels, chain, pixels, pixels, start, count);
+            }
+            narrowPixels(pixels, output.buffer.data() + start, count);
+        }
+    });
+}
+
+void ImagePipeline::composite(const HalfImage& imgIn1, const HalfImage& imgIn2, HalfImage& imgOut, const HalfImage& mask)
+{
+    imgOut.resize(imgIn1.width, imgIn1.height);
+    const PixelKernels& kernels = pixelKernels();
+    threadPool().parallelFor(imgIn1.pixelCount, CHAIN_GRAIN, [&](int begin, int end)
+    {
+        col4f* fg = threadBlock(1);
+        col4f* bg = threadBlock(2);
+        col4f* alpha = threadBlock(3);
+        for (int start = begin; start < end; start += CHAIN_BLOCK)
+        {
+            int count = std::min(CHAIN_BLOCK, end - start);
+            widenPixels(imgIn1.buffer.data() + start, fg, count);
+            widenPixels(imgIn2.buffer.data() + start, bg, count);
+            widenPixels(mask.buffer.data() + start, alpha, count);
+            kernels.composite(fg, bg, alpha, fg, count);
+            narrowPixels(fg, imgOut.buffer.data() + start, count);
+        }
+    });
+}
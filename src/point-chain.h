@@ -0,0 +1,94 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: point-chain.h
+ *
+ * A list of per-pixel operations that ImagePipeline::apply runs as one
+ * fused pass. Pixels are pushed through every op a block at a time while
+ * the block sits in L1, so a chain of N ops reads its inputs and writes
+ * its output once instead of N times.
+************************************************************************/
+
+#ifndef POINT_CHAIN_H
+#define POINT_CHAIN_H
+
+#include <vector>
+#include "color.h"
+
+class Image;
+
+// Pixels per block. 512 col4f is 8KB, leaving L1 room for the other
+// images a composite reads.
+const int CHAIN_BLOCK = 512;
+
+enum class PointOpType
+{
+    Negative,
+    ScaleBrightness,
+    ColorTint,
+    ToGreyscale,
+    Threshold,
+    ThresholdColor,
+    AdjustHSV,
+    Maskify,
+    Composite,      // current over image1, masked by image2's alpha
+    CompositeMasked // image1 over image2, masked by the current alpha
+};
+
+struct PointOp
+{
+    PointOpType type;
+    float value;
+    col4f color;
+    col4f_hsv_t hsv;
+    const Image* image1;
+    const Image* image2;
+};
+
+// Builder style, each call appends an op and returns the chain.
+// Images are referenced, not copied, and must outlive apply().
+class PointChain
+{
+public:
+    std::vector<PointOp> ops;
+
+    PointChain& negative() { return push({ PointOpType::Negative }); }
+    PointChain& scaleBrightness(float scale) { return push({ PointOpType::ScaleBrightness, scale }); }
+    PointChain& colorTint(col4f tint) { return push({ PointOpType::ColorTint, 0.0f, tint }); }
+    PointChain& toGreyscale(col4f weights) { return push({ PointOpType::ToGreyscale, 0.0f, weights }); }
+    PointChain& threshold(float threshold) { return push({ PointOpType::Threshold, threshold }); }
+    PointChain& thresholdColor(float threshold) { return push({ PointOpType::ThresholdColor, threshold }); }
+    PointChain& maskify() { return push({ PointOpType::Maskify }); }
+    PointChain& adjustHSV(col4f_hsv_t hsv)
+    {
+        PointOp op = { PointOpType::AdjustHSV };
+        op.hsv = hsv;
+        return push(op);
+    }
+    // composite(current, bg, out, mask)
+    PointChain& composite(const Image& bg, const Image& mask)
+    {
+        PointOp op = { PointOpType::Composite };
+        op.image1 = &bg;
+        op.image2 = &mask;
+        return push(op);
+    }
+    // composite(fg, bg, out, current), the current pixels are the mask
+    PointChain& compositeMasked(const Image& fg, const Image& bg)
+    {
+        PointOp op = { PointOpType::CompositeMasked };
+        op.image1 = &fg;
+        op.image2 = &bg;
+        return push(op);
+    }
+
+    void clear() { ops.clear(); }
+
+private:
+    PointChain& push(PointOp op)
+    {
+        ops.push_back(op);
+        return *this;
+    }
+};
+
+#endif
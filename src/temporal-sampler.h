@@ -1,61 +1,403 @@
 #ifndef TEMPORAL_SAMPLER_H
 #define TEMPORAL_SAMPLER_H
 
+#include <cmath>
+#include <functional>
 #include <vector>
 #include "math.h"
 #include "image.h"
 #include "color.h"
 #include "perlin-noise.h"
+#include "thread-pool.h"
+#include "frame-source.h"
+#include "frame-sequence.h"
+#include "frame-writer.h"
+#include "pixel-kernels.h"
 #include <iostream>
 
 
+/************************************************************************
+* Frames are either loaded into inputFrames and outputFrames, or mapped
+* from .cfs sequence containers so only the pages processFrame touches
+* are resident. Either way processFrame works through the views.
+************************************************************************/
+// Nearest copies the one frame a pixel's offset truncates to, Blended
+// mixes the two frames either side of it by the fractional part
+enum class TemporalMode
+{
+    Nearest,
+    Blended
+};
+
 class TemporalSampler
 {
     public:
+    TemporalMode mode = TemporalMode::Nearest;
     std::vector<Image> inputFrames;
     std::vector<Image> outputFrames;
+    FrameSequence inputSequence;
+    FrameSequence outputSequence;
+    std::vector<ConstImageView> inputs;
+    std::vector<ImageView> outputs;
+    // With halfStorage set loadFrames keeps frames as halves, half the
+    // memory. inputs and outputs are then unused, frames are widened as
+    // sample() reads them.
+    bool halfStorage = false;
+    std::vector<HalfImage> halfInputFrames;
+    std::vector<HalfImage> halfOutputFrames;
+    int width = 0;
+    int height = 0;
 
     int size()
     {
-        return inputFrames.size();
+        return inputs.size();
     }
     
-    void processFrame(int frameNo, int minFrameOffset, int maxFrameOffset, Image mask)
+    void processFrame(int frameNo, int minFrameOffset, int maxFrameOffset, const Image& mask)
     {
-        minFrameOffset = std::max(0, minFrameOffset);
-        maxFrameOffset = std::min(int(inputFrames.size() - 1), maxFrameOffset);
-
-        for (int x = 0; x < inputFrames[frameNo].width; x++)
+        if (halfInputFrames.empty())
+        {
+            sample(frameNo, minFrameOffset, maxFrameOffset, mask, outputs[frameNo]);
+            return;
+        }
+        frameScratch.resize(width, height);
+        sample(frameNo, minFrameOffset, maxFrameOffset, mask, view(frameScratch));
+        halfOutputFrames[frameNo].read(frameScratch);
+    }
+    
+    // Load frames 1 to frameCount of stem. Stops and returns false at a
+    // frame that's missing or isn't the first frame's size.
+    bool loadFrames(std::string stem, int frameCount, std::string extension)
+    {
+        inputFrames.resize(halfStorage ? 0 : frameCount);
+        outputFrames.resize(halfStorage ? 0 : frameCount);
+        halfInputFrames.resize(halfStorage ? frameCount : 0);
+        halfOutputFrames.resize(halfStorage ? frameCount : 0);
+        inputs.clear();
+        outputs.clear();
+        // Decode ahead on a couple of threads while frames are moved in
+        FrameSource frames(stem, extension, 1, frameCount, 4, 2);
+        Image image;
+        int frame;
+        int loaded = 0;
+        while (frames.next(image, frame))
         {
-            for (int y = 0; y < inputFrames[frameNo].height; y++)
+            std::cout << frame << std::endl;
+            // The first frame sets the size of every frame
+            if (loaded == 0)
+            {
+                width = image.width;
+                height = image.height;
+            }
+            if (image.width != width || image.height != height)
+            {
+                std::cerr << "ERROR: " << fileName(stem, frame, extension) << " doesn't match the clip size" << std::endl;
+                halfInputFrames.clear();
+                return false;
+            }
+            loaded++;
+            if (halfStorage)
             {
-                int frameOffset = int(linear_interpolation(mask(x, y).a, minFrameOffset, maxFrameOffset));
-                int index = clamp(frameNo + frameOffset, 0, inputFrames.size() - 1);
-                outputFrames[frameNo](x, y) = inputFrames[index](x, y);
+                halfInputFrames[frame - 1].read(image);
+                halfOutputFrames[frame - 1].resize(width, height);
+                continue;
             }
+            std::swap(inputFrames[frame - 1], image);
+            outputFrames[frame - 1].resize(width, height);
+        }
+        if (frames.failed() || loaded != frameCount)
+        {
+            std::cerr << "ERROR: Failed to load " << fileName(stem, loaded + 1, extension) << std::endl;
+            halfInputFrames.clear();
+            return false;
+        }
+        for (int i = 0; i < frameCount; i++)
+        {
+            inputs.push_back(halfStorage ? ConstImageView(nullptr, 0, 0, 0) : view(inputFrames[i]));
+            outputs.push_back(halfStorage ? ImageView { nullptr, 0, 0, 0 } : view(outputFrames[i]));
         }
+        return true;
     }
-    
-    void loadFrames(std::string stem, int frameCount, std::string extension)
+
+    // Map inputFile, a container made by buildSequence, and create a
+    // container the same size at outputFile for the results
+    bool mapFrames(const char* inputFile, const char* outputFile)
     {
-        inputFrames.resize(frameCount);
-        outputFrames.resize(frameCount);
-        for (int i = 1; i <= frameCount; i++)
+        if (!inputSequence.open(inputFile))
+        {
+            std::cerr << "ERROR: Failed to open sequence " << inputFile << std::endl;
+            return false;
+        }
+        if (!outputSequence.create(outputFile, inputSequence.size(), inputSequence.width(), inputSequence.height()))
         {
-            std::cout << i << std::endl;
-            inputFrames[i - 1].read(fileName(stem, i, extension).c_str());
-            outputFrames[i - 1].resize(inputFrames[i - 1].width, inputFrames[i - 1].height);
-            std::cout << i << std::endl;
+            return false;
         }
+        inputs.clear();
+        outputs.clear();
+        halfInputFrames.clear();
+        for (int i = 0; i < inputSequence.size(); i++)
+        {
+            inputs.push_back(inputSequence.frame(i));
+            outputs.push_back(outputSequence.writableFrame(i));
+        }
+        width = inputSequence.width();
+        height = inputSequence.height();
+        return true;
     }
     
-    void writeFrames(std::string stem, int frameCount, std::string extension)
+    /*
+     * Process a clip without holding it. A ring buffer the size of the
+     * offset window holds the input frames: frames are loaded just ahead
+     * of the output cursor and evicted once they fall behind it. Each
+     * output frame goes to the writer as soon as it's done. Peak memory
+     * is the window plus the loader's and writer's queues. makeMask
+     * fills the mask for each 0-based frame. Stops and returns false at
+     * an input frame that's missing or isn't the first frame's size.
+     */
+    bool streamFrames(std::string stem, int frameCount, std::string extension,
+                      std::string outputStem, std::string outputExtension,
+                      int minFrameOffset, int maxFrameOffset,
+                      const std::function<void(int frame, Image& mask)>& makeMask)
     {
+        clampOffsets(frameCount, minFrameOffset, maxFrameOffset);
+        int window = std::max(1, maxFrameOffset - minFrameOffset + 1);
+        std::vector<Image> ring(window);
+        inputs.assign(frameCount, ConstImageView(nullptr, 0, 0, 0));
+        outputs.clear();
+        halfInputFrames.clear();
+
+        FrameSource source(stem, extension, 1, frameCount);
+        FrameWriter writer;
+        Image output;
+        Image mask;
+        int loaded = 0;
+        for (int frameNo = 0; frameNo < frameCount; frameNo++)
+        {
+            // Loading frame n reuses the slot of frame n - window, which
+            // is before this frame's window starts
+            int last = std::min(frameCount - 1, frameNo + maxFrameOffset);
+            for (; loaded <= last; loaded++)
+            {
+                Image& slot = ring[loaded % window];
+                int frame;
+                if (!source.next(slot, frame) || frame != loaded + 1)
+                {
+                    std::cerr << "ERROR: Failed to load " << fileName(stem, loaded + 1, extension) << std::endl;
+                    inputs.clear();
+                    return false;
+                }
+                // The first frame sets the size of every frame
+                if (loaded == 0)
+                {
+                    width = slot.width;
+                    height = slot.height;
+                }
+                if (slot.width != width || slot.height != height)
+                {
+                    std::cerr << "ERROR: " << fileName(stem, frame, extension) << " doesn't match the clip size" << std::endl;
+                    inputs.clear();
+                    return false;
+                }
+                inputs[loaded] = view(slot);
+            }
+
+            makeMask(frameNo, mask);
+            output.resize(width, height);
+            sample(frameNo, minFrameOffset, maxFrameOffset, mask, view(output));
+            writer.write(output, fileName(outputStem, frameNo + 1, outputExtension));
+        }
+        inputs.clear();
+        return true;
+    }
+
+    // Writes every processed frame, as many as were loaded or mapped
+    void writeFrames(std::string stem, std::string extension)
+    {
+        FrameWriter writer;
+        Image image(width, height);
+        int frameCount = int(halfInputFrames.empty() ? outputs.size() : halfOutputFrames.size());
         for (int i = 1; i <= frameCount; i++)
         {
-            outputFrames[i].write(fileName(stem, i, extension).c_str());
+            if (halfInputFrames.empty())
+            {
+                std::copy(outputs[i - 1].at(0, 0), outputs[i - 1].at(0, height), image.buffer.begin());
+            }
+            else
+            {
+                halfOutputFrames[i - 1].write(image);
+            }
+            writer.write(image, fileName(stem, i, extension));
         }
     }
+
+    private:
+    Image frameScratch; // Float output for half storage, narrowed after
+
+    // Rows averaging runs shorter than this are gathered directly
+    static const int SHORT_RUN = 8;
+
+    // Pixels x0 to x1 of row y, all read from frame
+    struct SampleRun
+    {
+        int frame;
+        int y;
+        int x0;
+        int x1;
+    };
+
+    void clampOffsets(int frameCount, int& minFrameOffset, int& maxFrameOffset)
+    {
+        minFrameOffset = std::max(0, minFrameOffset);
+        maxFrameOffset = std::min(frameCount - 1, maxFrameOffset);
+    }
+
+    /*
+     * Every output pixel copies the same pixel of the frame its mask
+     * alpha picks out of the offset range, or in Blended mode mixes the
+     * two frames either side of it. Frames outside the window are never
+     * read, whatever the alpha.
+     *
+     * Each band of rows turns its mask into runs of neighbouring pixels
+     * that read the same frame, quantizing a row of alphas at a time,
+     * then sorts the runs by frame. Copying them in that order reads
+     * one source frame after another, front to back, rather than
+     * hopping between frames pixel by pixel.
+     */
+    void sample(int frameNo, int minFrameOffset, int maxFrameOffset, const Image& mask, ImageView out)
+    {
+        clampOffsets(inputs.size(), minFrameOffset, maxFrameOffset);
+        int lastFrame = int(inputs.size()) - 1;
+        int firstInWindow = clamp(frameNo + minFrameOffset, 0, lastFrame);
+        int lastInWindow = clamp(frameNo + maxFrameOffset, 0, lastFrame);
+        bool blended = mode == TemporalMode::Blended;
+        bool halves = !halfInputFrames.empty();
+        const PixelKernels& kernels = pixelKernels();
+
+        threadPool().parallelFor(height, 1, [&](int y0, int y1)
+        {
+            thread_local std::vector<int> indices;
+            thread_local std::vector<float> weights;
+            thread_local std::vector<SampleRun> runs;
+            thread_local std::vector<SampleRun> sorted;
+            thread_local std::vector<int> starts;
+            thread_local std::vector<col4f> widened[2];
+            indices.resize(width);
+            weights.resize(blended ? size_t(y1 - y0) * width : 0);
+            runs.clear();
+
+            // Pixels x0 to x1 of row y of frame, widened into slot's row
+            // first for half storage
+            auto source = [&](int frame, int x0, int x1, int y, int slot)
+            {
+                if (!halves)
+                {
+                    return inputs[frame].at(x0, y);
+                }
+                widened[slot].resize(width);
+                widenPixels(&halfInputFrames[frame](x0, y), widened[slot].data(), x1 - x0);
+                return (const col4f*) widened[slot].data();
+            };
+            auto copySpan = [&](int frame, int x0, int x1, int y)
+            {
+                if (halves)
+                {
+                    widenPixels(&halfInputFrames[frame](x0, y), out.at(x0, y), x1 - x0);
+                    return;
+                }
+                const col4f* in = inputs[frame].at(x0, y);
+                std::copy(in, in + (x1 - x0), out.at(x0, y));
+            };
+            // Blend from frame to the next one in the window
+            auto blendSpan = [&](int frame, int x0, int x1, int y)
+            {
+                int next = std::min(frame + 1, lastInWindow);
+                kernels.blend(source(frame, x0, x1, y, 0), source(next, x0, x1, y, 1),
+                              &weights[size_t(y - y0) * width + x0], out.at(x0, y), x1 - x0);
+            };
+
+            for (int y = y0; y < y1; y++)
+            {
+                const col4f* maskRow = &mask(0, y);
+                if (blended)
+                {
+                    float* rowWeights = &weights[size_t(y - y0) * width];
+                    for (int x = 0; x < width; x++)
+                    {
+                        float frameOffset = linear_interpolation(maskRow[x].a, minFrameOffset, maxFrameOffset);
+                        float whole = std::floor(frameOffset);
+                        int index = frameNo + int(whole);
+                        rowWeights[x] = (index < firstInWindow || index >= lastInWindow) ? 0.0f : frameOffset - whole;
+                        indices[x] = clamp(index, firstInWindow, lastInWindow);
+                    }
+                }
+                else
+                {
+                    for (int x = 0; x < width; x++)
+                    {
+                        int frameOffset = int(linear_interpolation(maskRow[x].a, minFrameOffset, maxFrameOffset));
+                        indices[x] = clamp(frameNo + frameOffset, firstInWindow, lastInWindow);
+                    }
+                }
+
+                size_t rowStart = runs.size();
+                for (int x = 0; x < width;)
+                {
+                    int start = x;
+                    while (++x < width && indices[x] == indices[start]) {}
+                    runs.push_back({ indices[start], y, start, x });
+                }
+                // A noisy mask breaks the row into tiny runs, cheaper to
+                // gather pixel by pixel than to sort
+                if ((runs.size() - rowStart) * SHORT_RUN > size_t(width))
+                {
+                    runs.resize(rowStart);
+                    for (int x = 0; x < width; x++)
+                    {
+                        if (blended)
+                        {
+                            blendSpan(indices[x], x, x + 1, y);
+                        }
+                        else if (halves)
+                        {
+                            copySpan(indices[x], x, x + 1, y);
+                        }
+                        else
+                        {
+                            *out.at(x, y) = *inputs[indices[x]].at(x, y);
+                        }
+                    }
+                }
+            }
+
+            // Counting sort, stable so each frame's runs stay row-major
+            starts.assign(lastFrame + 2, 0);
+            for (const SampleRun& run : runs)
+            {
+                starts[run.frame + 1]++;
+            }
+            for (int i = 0; i <= lastFrame; i++)
+            {
+                starts[i + 1] += starts[i];
+            }
+            sorted.resize(runs.size());
+            for (const SampleRun& run : runs)
+            {
+                sorted[starts[run.frame]++] = run;
+            }
+
+            for (const SampleRun& run : sorted)
+            {
+                if (blended)
+                {
+                    blendSpan(run.frame, run.x0, run.x1, run.y);
+                }
+                else
+                {
+                    copySpan(run.frame, run.x0, run.x1, run.y);
+                }
+            }
+        });
+    }
 };
         
         
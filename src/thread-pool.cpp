@@ -0,0 +1,178 @@
+/********************************************
+ * Author: Kyle Bueche
+ * File: thread-pool.cpp
+ *
+ *******************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include "thread-pool.h"
+
+// Chunks per thread, so a thread that lands slow chunks can be helped
+static const int CHUNKS_PER_THREAD = 4;
+
+// Set while running a chunk or inside a SerialScope, parallelFor runs inline
+static thread_local bool insideChunk = false;
+
+ThreadPool::ThreadPool(int threads)
+    : threadCount(std::max(1, threads)), queued(0), stopping(false)
+{
+    for (int i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i + 1 < threadCount; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Own queue from the front, in order, otherwise steal from the back of another
+bool ThreadPool::take(int self, Task& task)
+{
+    for (int i = 0; i < threadCount; i++)
+    {
+        Queue& queue = *queues[(self + i) % threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+        if (i == 0)
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(const Task& task)
+{
+    {
+        SerialScope serial;
+        (*task.body)(task.begin, task.end);
+    }
+    if (--(*task.remaining) == 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        finished.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(int self)
+{
+    Task task;
+    while (true)
+    {
+        if (take(self, task))
+        {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return queued > 0 || stopping; });
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    // Round the target chunk size up to a whole number of grains
+    int target = (count + CHUNKS_PER_THREAD * threadCount - 1) / (CHUNKS_PER_THREAD * threadCount);
+    grain = std::max(1, grain);
+    grain *= (target + grain - 1) / grain;
+    int chunks = (count + grain - 1) / grain;
+    if (threadCount == 1 || chunks == 1 || insideChunk)
+    {
+        body(0, count);
+        return;
+    }
+
+    // Contiguous runs of chunks per queue, so each thread starts on
+    // neighbouring rows before anyone steals
+    std::atomic<int> remaining(chunks);
+    for (int c = 0; c < chunks; c++)
+    {
+        Queue& queue = *queues[size_t(c) * threadCount / chunks];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ &body, c * grain, std::min(count, (c + 1) * grain), &remaining });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued += chunks;
+    }
+    wake.notify_all();
+
+    // The caller works too, then waits for whatever is still running
+    Task task;
+    while (remaining > 0 && take(threadCount - 1, task))
+    {
+        run(task);
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    finished.wait(lock, [&] { return remaining == 0; });
+}
+
+SerialScope::SerialScope() : previous(insideChunk)
+{
+    insideChunk = true;
+}
+
+SerialScope::~SerialScope()
+{
+    insideChunk = previous;
+}
+
+static int defaultThreadCount()
+{
+    const char* env = std::getenv("COMPOSITOR_THREADS");
+    if (env != nullptr && std::atoi(env) > 0)
+    {
+        return std::atoi(env);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static std::unique_ptr<ThreadPool>& sharedPool()
+{
+    static std::unique_ptr<ThreadPool> pool = std::make_unique<ThreadPool>(defaultThreadCount());
+    return pool;
+}
+
+ThreadPool& threadPool()
+{
+    return *sharedPool();
+}
+
+void setThreadCount(int threads)
+{
+    sharedPool() = std::make_unique<ThreadPool>(threads > 0 ? threads : defaultThreadCount());
+}
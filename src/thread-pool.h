@@ -0,0 +1,91 @@
+/************************************************************************
+ * Author: Kyle Bueche
+ * File: thread-pool.h
+ *
+ * Shared work-stealing thread pool. parallelFor splits a range into
+ * chunks and deals them out to per-thread deques, threads that run out
+ * steal from the others. Callers hand it chunks that write disjoint
+ * output and don't depend on where the chunk edges fall, so results are
+ * identical no matter how many threads run.
+************************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threads counts the calling thread, so ThreadPool(1) starts no workers
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    int size() const { return threadCount; }
+
+    /*
+     * Run body(begin, end) over chunks covering [0, count) and return once
+     * all of them are done. Every chunk but the last is a whole number of
+     * grains long, so vector kernels see the same lane alignment whatever
+     * the thread count. There are a few chunks per thread so stealing can
+     * even out uneven work. Called from inside a chunk it runs inline.
+     */
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& body);
+
+private:
+    struct Task
+    {
+        const std::function<void(int, int)>* body;
+        int begin;
+        int end;
+        std::atomic<int>* remaining;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    int threadCount;
+    // One per thread, the last is shared by callers from outside the pool
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping;
+
+    bool take(int self, Task& task);
+    void run(const Task& task);
+    void workerLoop(int self);
+};
+
+/************************************************************************
+* While alive, parallelFor calls on this thread run inline. For work that
+* is already parallel at a coarser level, like one frame per thread.
+************************************************************************/
+class SerialScope
+{
+public:
+    SerialScope();
+    ~SerialScope();
+
+private:
+    bool previous;
+};
+
+// The pool ImagePipeline and friends share
+ThreadPool& threadPool();
+// Rebuild the shared pool, 0 picks COMPOSITOR_THREADS or the hardware
+// thread count. Not safe while the pool is busy.
+void setThreadCount(int threads);
+
+#endif
@@ -1,12 +1,43 @@
 #ifndef VIEWPORT_H
 #define VIEWPORT_H
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <cmath>
 #include <iostream>
 #include "image.h"
+#include "mip-pyramid.h"
+#include "pixel-kernels.h"
+#include "thread-pool.h"
 
+// Replace overwrites what's below, the way drawImage always has. Over is
+// straight alpha Porter-Duff over.
+enum class LayerBlend
+{
+    Replace,
+    Over
+};
+
+// One entry of Viewport::drawLayers, placed the same way as drawImage
+struct Layer
+{
+    const Image* image;
+    const MipPyramid* mips; // When set, drawn from the pyramid and image is ignored
+    vec2 scale;
+    float rotation;
+    vec2 translation;
+    LayerBlend blend;
+    const Affine2* inverse = nullptr; // When set, used instead of scale, rotation and translation
+};
 
+// What drawImage takes to place an image, for one frame
+struct Placement
+{
+    vec2 scale;
+    float rotation;
+    vec2 translation;
+};
 
 class Viewport
 {
@@ -50,6 +81,102 @@ public:
     }
 
     void drawImage(const Image& image, vec2 scale, float rotation, vec2 translation)
+    {
+        drawImage(image, inverseTransform(image, scale, rotation, translation));
+    }
+
+    // Same placement as drawing mips.level(0), but sampled trilinearly
+    // from the pyramid once the image is minified
+    void drawImage(const MipPyramid& mips, vec2 scale, float rotation, vec2 translation)
+    {
+        drawImage(mips, inverseTransform(mips.level(0), scale, rotation, translation));
+    }
+
+    // Placed by a precomputed viewport pixel to image pixel transform
+    void drawImage(const Image& image, const Affine2& inverse)
+    {
+        drawSource(resolve(image, nullptr, inverse));
+    }
+
+    void drawImage(const MipPyramid& mips, const Affine2& inverse)
+    {
+        drawSource(resolve(mips.level(0), &mips, inverse));
+    }
+
+    /*
+    * The transform drawImage samples through, from viewport pixels to
+    * the image's pixels. It only depends on the placement and the two
+    * sizes, so it can be worked out once and drawn any number of times,
+    * or composed with other transforms first.
+    */
+    Affine2 inverseTransform(const Image& image, vec2 scale, float rotation, vec2 translation) const
+    {
+        return imageMapping(image, scale, rotation, translation);
+    }
+
+    /*
+    * inverseTransform for every frame in [first, last], frame first at
+    * index 0. Lets an animation evaluate its keyframes for the whole
+    * range up front instead of inside every frame's render.
+    */
+    std::vector<Affine2> inverseTransforms(const Image& image, int first, int last,
+                                           const std::function<Placement(int)>& placement) const
+    {
+        std::vector<Affine2> transforms;
+        for (int frame = first; frame <= last; frame++)
+        {
+            Placement p = placement(frame);
+            transforms.push_back(inverseTransform(image, p.scale, p.rotation, p.translation));
+        }
+        return transforms;
+    }
+
+    /*
+    * Every layer in one pass over the viewport, bottom layer first. The
+    * viewport is cut into tiles and each tile runs the layers that
+    * touch it while it sits in cache, so the frame is written once
+    * however many layers there are. With a clear color the tiles are
+    * cleared in the same pass. A tile starts at the top layer that hides
+    * it completely, Replace or an opaque pyramid, skipping everything
+    * underneath, the clear included.
+    */
+    void drawLayers(const std::vector<Layer>& layers)
+    {
+        drawLayers(layers, nullptr);
+    }
+
+    void drawLayers(const std::vector<Layer>& layers, col4f clear)
+    {
+        drawLayers(layers, &clear);
+    }
+
+private:
+    // Pixels of padding around the analytic bounds, more than the float
+    // error between them and the sampler's own coordinates
+    static const int COVER_PADDING = 2;
+    // Side of the square tiles drawLayers works through, 256KB of col4f
+    static const int LAYER_TILE = 128;
+
+    /*
+    * drawImage maps a viewport point p to image coordinates
+    *   u = dot(p - topLeft, norm_u) / len_u,  v = dot(p - topLeft, norm_v) / len_v
+    * with p = (2x / width - 1, 2y / height - 1), which expands to one
+    * affine transform from viewport pixels to image pixels.
+    */
+    Affine2 pixelMapping(vec2 topLeft, vec2 norm_u, vec2 norm_v, float len_u, float len_v) const
+    {
+        vec2 corner = { -1.0f, -1.0f };
+        vec2 origin = corner - topLeft;
+        float stepX = 2.0f / float(viewport.width);
+        float stepY = 2.0f / float(viewport.height);
+        return {
+            stepX * norm_u.x / len_u, stepX * norm_v.x / len_v,
+            stepY * norm_u.y / len_u, stepY * norm_v.y / len_v,
+            dot(origin, norm_u) / len_u, dot(origin, norm_v) / len_v
+        };
+    }
+
+    Affine2 imageMapping(const Image& image, vec2 scale, float rotation, vec2 translation) const
     {
         // Initial position of image, with height set to 2.0f, and centered on (0.0f, 0.0f)
         float scaledHeight = 2.0f;
@@ -64,21 +191,14 @@ public:
         // to the top Left Position, the left to right vector, and the
         // top to bottom vector each in turn
 
-        // scale
-        vec2 scaledPos = vecScale(scale, topLeftPos);
-        vec2 scaledLtoR = vecScale(scale, leftToRight);
-        vec2 scaledTtoB = vecScale(scale, topToBottom);
-
-        // rotate
+        // One transform for all three, sin and cos taken once
         float radians = rotation * std::numbers::pi / 180.0f;
-        vec2 rotatedPos = vecRotate(radians, scaledPos);
-        vec2 rotatedLtoR = vecRotate(radians, scaledLtoR);
-        vec2 rotatedTtoB = vecRotate(radians, scaledTtoB);
+        Affine2 placement = affineTranslate(translation) * affineRotate(radians) * affineScale(scale);
 
-        // translate
-        vec2 translatedPos = vecTranslate(translation, rotatedPos);
-        vec2 translatedLtoR = vecTranslate(translation, rotatedLtoR);
-        vec2 translatedTtoB = vecTranslate(translation, rotatedTtoB);
+        vec2 translatedPos = transformPoint(placement, topLeftPos);
+        // The edge vectors go through the translation too, as they always have
+        vec2 translatedLtoR = transformPoint(placement, leftToRight);
+        vec2 translatedTtoB = transformPoint(placement, topToBottom);
 
         /*
         float halfWidth = float(image.width) / 2.0f;
@@ -150,54 +270,244 @@ public:
         vec2 norm_v = normalized(v);
 
         */
-        for (int x = 0; x < viewport.width; x++)
+        return pixelMapping(translatedPos, norm_u, norm_v, len_u, len_v);
+    }
+
+    // A draw's image, placement and filtering, worked out once per draw
+    struct Source
+    {
+        const Image* image;
+        const MipPyramid* mips; // Trilinear between levels fine and fine + 1 when set
+        int fine;
+        float t;
+        Affine2 mapping; // Viewport pixel to image pixel
+        Rect bounds; // Viewport pixels the draw can touch
+    };
+
+    /*
+    * With a pyramid the level comes from the longer side of a viewport
+    * pixel's footprint in the image, the mapping's Jacobian, which is the
+    * same everywhere for an affine draw. Magnified and 1:1 draws sample
+    * level 0 bilinearly either way.
+    */
+    Source resolve(const Image& image, const MipPyramid* mips, const Affine2& mapping) const
+    {
+        Source source = { &image, nullptr, 0, 0.0f, mapping };
+        source.bounds = coveredBounds(image, source.mapping);
+        const Affine2& m = source.mapping;
+        float lod = std::log2(std::max(std::hypot(m.a, m.b), std::hypot(m.c, m.d)));
+        if (mips && mips->levelCount() > 1 && lod > 0.0f)
         {
-            for (int y = 0; y < viewport.height; y++)
+            source.mips = mips;
+            source.fine = std::min(int(lod), mips->levelCount() - 1);
+            source.t = std::clamp(lod - float(source.fine), 0.0f, 1.0f);
+        }
+        return source;
+    }
+
+    void drawSource(const Source& source)
+    {
+        // Rows are independent, so bands of them go to the thread pool
+        threadPool().parallelFor(source.bounds.height(), 1, [&](int y0, int y1)
+        {
+            for (int y = source.bounds.y0 + y0; y < source.bounds.y0 + y1; y++)
+            {
+                sampleRow(source, y, source.bounds.x0, source.bounds.x1, &viewport(source.bounds.x0, y));
+            }
+        });
+    }
+
+    /*
+    * Samples of row y between x0 and x1 into out, which holds pixel x0
+    * onwards. Only the covered span is visited and the sampler's bounds
+    * test still decides exactly which pixels are written.
+    */
+    void sampleRow(const Source& source, int y, int x0, int x1, col4f* out) const
+    {
+        const Image& image = *source.image;
+        const Affine2& m = source.mapping;
+        int spanBegin;
+        int spanEnd;
+        coveredSpan(image, m, y, spanBegin, spanEnd);
+        spanBegin = std::max(spanBegin, x0);
+        spanEnd = std::min(spanEnd, x1);
+        if (spanBegin >= spanEnd)
+        {
+            return;
+        }
+        // Image coordinates step by a constant along the row from x = 0, so
+        // a pixel samples the same wherever its span was cut
+        float u = m.tx + float(y) * m.c;
+        float v = m.ty + float(y) * m.d;
+        col4f* span = out + (spanBegin - x0);
+        if (source.mips)
+        {
+            trilinearSample(*source.mips, source.fine, source.t, u, v, m.a, m.b, span, spanBegin, spanEnd);
+        }
+        else
+        {
+            pixelKernels().affineSample(image.buffer.data(), image.width, image.height, u, v, m.a, m.b, span, spanBegin, spanEnd);
+        }
+    }
+
+    void drawLayers(const std::vector<Layer>& layers, const col4f* clear)
+    {
+        std::vector<Source> sources;
+        for (const Layer& layer : layers)
+        {
+            const Image& image = layer.mips ? layer.mips->level(0) : *layer.image;
+            Affine2 mapping = layer.inverse ? *layer.inverse : imageMapping(image, layer.scale, layer.rotation, layer.translation);
+            sources.push_back(resolve(image, layer.mips, mapping));
+        }
+        // Layers that hide whatever is below wherever they're drawn. Over
+        // with an opaque source is exactly Replace, so it samples straight
+        // into the viewport too.
+        std::vector<bool> hides;
+        for (const Layer& layer : layers)
+        {
+            hides.push_back(layer.blend == LayerBlend::Replace || (layer.mips && layer.mips->opaque()));
+        }
+        const PixelKernels& kernels = pixelKernels();
+        int tilesX = (viewport.width + LAYER_TILE - 1) / LAYER_TILE;
+        int tilesY = (viewport.height + LAYER_TILE - 1) / LAYER_TILE;
+        threadPool().parallelFor(tilesX * tilesY, 1, [&](int t0, int t1)
+        {
+            thread_local std::vector<col4f> samples;
+            for (int t = t0; t < t1; t++)
+            {
+                int x = (t % tilesX) * LAYER_TILE;
+                int y = (t / tilesX) * LAYER_TILE;
+                Rect tile = { x, y, std::min(x + LAYER_TILE, viewport.width), std::min(y + LAYER_TILE, viewport.height) };
+                int bottom = int(layers.size()) - 1;
+                while (bottom >= 0 && !(hides[bottom] && coversTile(sources[bottom], tile)))
+                {
+                    bottom--;
+                }
+                if (clear && bottom < 0)
+                {
+                    for (int row = tile.y0; row < tile.y1; row++)
+                    {
+                        std::fill(&viewport(tile.x0, row), &viewport(tile.x1, row), *clear);
+                    }
+                }
+                for (size_t i = std::max(bottom, 0); i < layers.size(); i++)
+                {
+                    Rect area = intersect(tile, sources[i].bounds);
+                    if (area.empty())
+                    {
+                        continue;
+                    }
+                    for (int row = area.y0; row < area.y1; row++)
+                    {
+                        col4f* pixels = &viewport(area.x0, row);
+                        if (hides[i])
+                        {
+                            sampleRow(sources[i], row, area.x0, area.x1, pixels);
+                            continue;
+                        }
+                        // Pixels the layer misses stay transparent and pass through
+                        samples.assign(area.width(), col4f(0.0f, 0.0f, 0.0f, 0.0f));
+                        sampleRow(sources[i], row, area.x0, area.x1, samples.data());
+                        kernels.alphaOver(samples.data(), pixels, pixels, area.width());
+                    }
+                }
+            }
+        });
+    }
+
+    /*
+    * Whether every pixel of tile gets a sample. Coverage is convex, so
+    * checking the corners is enough, a texel inside the sampler's own
+    * limits to stay clear of float error along the edges.
+    */
+    bool coversTile(const Source& source, Rect tile) const
+    {
+        const Affine2& m = source.mapping;
+        float maxU = float(source.image->width - 2);
+        float maxV = float(source.image->height - 2);
+        for (int y : { tile.y0, tile.y1 - 1 })
+        {
+            for (int x : { tile.x0, tile.x1 - 1 })
             {
-                vec2 viewportPoint;
-                viewportPoint.x = linear_interpolation(float(x) / float(viewport.width), -1.0f, 1.0f);
-                viewportPoint.y = linear_interpolation(float(y) / float(viewport.height), -1.0f, 1.0f);
-                vec2 h = viewportPoint - translatedPos;
-                float sideLenX = dot(h, norm_u);
-                float sideLenY = dot(h, norm_v);
-
-                // Distances when pixels have side dimensions 1x1
-                float distX = sideLenX / len_u;
-                float distY = sideLenY / len_v;
-                int topLeftX = int(distX);
-                int topLeftY = int(distY);
-                float tx = distX - float(topLeftX);
-                float ty = distY - float(topLeftY);
-                if (topLeftX >= 0 && topLeftX + 1 < image.width
-                    && topLeftY >= 0 && topLeftY + 1 < image.height)
+                float u = std::fma(float(x), m.a, m.tx + float(y) * m.c);
+                float v = std::fma(float(x), m.b, m.ty + float(y) * m.d);
+                if (!(u > 0.0f && u < maxU && v > 0.0f && v < maxV))
                 {
-                    rgba_quad_t rgbaQuad;
-                    rgbaQuad.topLeft = image(topLeftX, topLeftY);
-                    rgbaQuad.topRight = image(topLeftX + 1, topLeftY);
-                    rgbaQuad.bottomLeft = image(topLeftX, topLeftY + 1);
-                    rgbaQuad.bottomRight = image(topLeftX + 1, topLeftY + 1);
-                    viewport(x, y) = bilinear_interpolation(tx, ty, rgbaQuad);
+                    return false;
                 }
+            }
+        }
+        return true;
+    }
+
+    /*
+    * A pixel is sampled when (u, v) lands in (-1, image.width - 1) x
+    * (-1, image.height - 1), a parallelogram on screen. Its bounds come
+    * from its corners, and along one row u and v are linear in x, so the
+    * covered pixels are the one span where both are in range.
+    */
+    Rect coveredBounds(const Image& image, const Affine2& m) const
+    {
+        Rect all = { 0, 0, viewport.width, viewport.height };
+        float det = determinant(m);
+        if (!std::isfinite(det) || std::abs(det) < 1e-20f)
+        {
+            return all; // Degenerate, leave it to the per-pixel test
+        }
+        Affine2 toViewport = inverse(m);
+        float minX = INFINITY;
+        float maxX = -INFINITY;
+        float minY = INFINITY;
+        float maxY = -INFINITY;
+        for (float u : { -1.0f, float(image.width - 1) })
+        {
+            for (float v : { -1.0f, float(image.height - 1) })
+            {
+                vec2 corner = transformPoint(toViewport, { u, v });
+                minX = std::min(minX, corner.x);
+                maxX = std::max(maxX, corner.x);
+                minY = std::min(minY, corner.y);
+                maxY = std::max(maxY, corner.y);
+            }
+        }
+        auto first = [](float value, int limit) { return int(std::clamp(std::floor(value) - COVER_PADDING, 0.0f, float(limit))); };
+        auto last = [](float value, int limit) { return int(std::clamp(std::ceil(value) + COVER_PADDING + 1, 0.0f, float(limit))); };
+        Rect bounds = { first(minX, viewport.width), first(minY, viewport.height), last(maxX, viewport.width), last(maxY, viewport.height) };
+        return bounds.empty() ? Rect { 0, 0, 0, 0 } : bounds;
+    }
 
-            //    int viewportX = int(translated.x + halfWidth);
-            //    int viewportY = int(translated.y + halfHeight);
-            //    if (viewportX > 0 && viewportX < viewport.width
-            //        && viewportY > 0 && viewportY < viewport.height
-            //        && x + 1 < image.width && y + 1 < image.height)
-            //    {
-            //        rgba_quad_t rgbaQuad;
-            //        rgbaQuad.topLeft = image(x, y);
-            //        rgbaQuad.topRight = image(x + 1, y);
-            //        rgbaQuad.bottomLeft = image(x, y + 1);
-            //        rgbaQuad.bottomRight = image(x + 1, y + 1);
-
-            //        vec2 topLeft;
-            //        topLeft.x = float(x);
-            //        topLeft.y = float(y);
-
-            //        viewport(viewportX, viewportY) = rgbaQuad.topLeft; //bilinear_interpolation(translated, topLeft, rgbaQuad);
+    void coveredSpan(const Image& image, const Affine2& m, int y, int& spanBegin, int& spanEnd) const
+    {
+        float lo = 0.0f;
+        float hi = float(viewport.width);
+        // Narrow [lo, hi] to where -1 < slope * x + offset < limit
+        auto clip = [&](float slope, float offset, float limit)
+        {
+            if (std::abs(slope) < 1e-20f)
+            {
+                if (!(offset > -1.0f && offset < limit))
+                {
+                    hi = -INFINITY;
+                }
+                return;
             }
+            float x0 = (-1.0f - offset) / slope;
+            float x1 = (limit - offset) / slope;
+            lo = std::max(lo, std::min(x0, x1));
+            hi = std::min(hi, std::max(x0, x1));
+        };
+        clip(m.a, m.tx + float(y) * m.c, float(image.width - 1));
+        clip(m.b, m.ty + float(y) * m.d, float(image.height - 1));
+        if (hi < lo)
+        {
+            spanBegin = spanEnd = 0;
+            return;
         }
+        float first = std::floor(lo) - COVER_PADDING;
+        float last = std::ceil(hi) + COVER_PADDING + 1;
+        // NaN falls back to the whole row
+        spanBegin = std::isnan(first) ? 0 : int(std::clamp(first, 0.0f, float(viewport.width)));
+        spanEnd = std::isnan(last) ? viewport.width : int(std::clamp(last, float(spanBegin), float(viewport.width)));
     }
 };
 